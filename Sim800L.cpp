@@ -60,6 +60,7 @@
 #include "Arduino.h"
 #include "Sim800L.h"
 #include <NeoSWSerial.h>
+#include <EEPROM.h>
 
 //NeoSWSerial SIM(RX_PIN,TX_PIN);
 //String _buffer;
@@ -102,18 +103,7 @@ Sim800L::Sim800L(uint8_t rx, uint8_t tx, uint8_t rst, uint8_t led) : NeoSWSerial
 
 void Sim800L::begin()
 {
-
-    pinMode(RESET_PIN, OUTPUT);
-
-    _baud = DEFAULT_BAUD_RATE;          // Default baud rate 9600
-    this->NeoSWSerial::begin(_baud);
-
-    _sleepMode = 0;
-    _functionalityMode = 1;
-
-    if (LED_FLAG) pinMode(LED_PIN, OUTPUT);
-
-    // _buffer.reserve(BUFFER_RESERVE_MEMORY); // Reserve memory to prevent intern fragmention
+    begin(DEFAULT_BAUD_RATE);           // Default baud rate 9600
 }
 
 void Sim800L::begin(uint32_t baud)
@@ -124,10 +114,7 @@ void Sim800L::begin(uint32_t baud)
     _baud = baud;
     this->NeoSWSerial::begin(_baud);
 
-    _sleepMode = 0;
-    _functionalityMode = 1;
-
-    if (LED_FLAG) pinMode(LED_PIN, OUTPUT);
+    _init();
 
     // _buffer.reserve(BUFFER_RESERVE_MEMORY); // Reserve memory to prevent intern fragmention
 }
@@ -145,11 +132,7 @@ bool Sim800L::setSleepMode(bool state)
     if (_sleepMode) this->NeoSWSerial::print(F("AT+CSCLK=1\r\n "));
     else            this->NeoSWSerial::print(F("AT+CSCLK=0\r\n "));
 
-    if ( (_readSerial().indexOf("ER")) == -1)
-    {
-        return false;
-    }
-    else return true;
+    return _commandError();
     // Error found, return 1
     // Error NOT found, return 0
 }
@@ -185,11 +168,7 @@ bool Sim800L::setFunctionalityMode(uint8_t fun)
             break;
         }
 
-        if ( (_readSerial().indexOf("ER")) == -1)
-        {
-            return false;
-        }
-        else return true;
+        return _commandError();
         // Error found, return 1
         // Error NOT found, return 0
     }
@@ -201,158 +180,255 @@ uint8_t Sim800L::getFunctionalityMode()
     return _functionalityMode;
 }
 
-bool Sim800L::setMessageStorage(String value)
+bool Sim800L::setMessageStorage(const char* value)
 {
-    String command;
-    command  = "AT+CPMS=\"";
-    command += value;
-    command += "\"\r\n";
+    this->NeoSWSerial::print(F("AT+CPMS=\""));
+    this->NeoSWSerial::print(value);
+    this->NeoSWSerial::print(F("\"\r\n"));
 
     // Can take up to 5 seconds
 
-    this->NeoSWSerial::print(command);
-
-    if ( (_readSerialUntil(5000).indexOf("ER")) == -1)
-    {
-        return true;
-    }
-    return false;
+    return !_commandError(5000);
 }
 
-bool Sim800L::setMessageFormat(String value)
+bool Sim800L::setMessageFormat(const char* value)
 {
-    String command;
-    command  = "AT+CMGF=";
-    command += value;
-    command += "\r\n";
+    this->NeoSWSerial::print(F("AT+CMGF="));
+    this->NeoSWSerial::print(value);
+    this->NeoSWSerial::print(F("\r\n"));
 
     // Can take up to 5 seconds
 
-    this->NeoSWSerial::print(command);
-	String _buffer = _readSerialUntil(5000);
-    if ( (_buffer.indexOf("ER")) == -1)
-    {
-        return true;
-    }
-    return false;
+    return !_commandError(5000);
 }
 
-bool Sim800L::setClip(String value)
+bool Sim800L::setClip(const char* value)
 {
 	// Activamos (1) o desactivamos (0) la deteccion de llamadas
-    String command;
-    command  = "AT+CLIP=";
-    command += value;
-    command += "\r\n";
+    this->NeoSWSerial::print(F("AT+CLIP="));
+    this->NeoSWSerial::print(value);
+    this->NeoSWSerial::print(F("\r\n"));
 
     // Can take up to 5 seconds
 
-    this->NeoSWSerial::print(command);
-	String _buffer = _readSerialUntil(5000);
-    if ( (_buffer.indexOf("ER")) == -1)
-    {
-        return true;
-    }
-    return false;
+    return !_commandError(5000);
 }
 
-bool Sim800L::setPIN(String pin)
+bool Sim800L::setPIN(const char* pin)
 {
-    String command;
-    command  = "AT+CPIN=";
-    command += pin;
-    command += "\r";
+    this->NeoSWSerial::print(F("AT+CPIN="));
+    this->NeoSWSerial::print(pin);
+    this->NeoSWSerial::print(F("\r"));
 
     // Can take up to 5 seconds
 
-    this->NeoSWSerial::print(command);
-
-    if ( (_readSerial(5000).indexOf("ER")) == -1)
-    {
-        return false;
-    }
-    else return true;
+    return _commandError(5000);
     // Error found, return 1
     // Error NOT found, return 0
 }
 
-String Sim800L::getProductInfo()
+int Sim800L::getProductInfo(char* buffer, size_t size)
 {
-    this->NeoSWSerial::print("ATI\r");
-    return (_readSerial());
+    this->NeoSWSerial::print(F("ATI\r"));
+    return _readResponse(buffer, size);
 }
 
 
-String Sim800L::getOperatorsList()
+int Sim800L::getOperatorsList(char* buffer, size_t size)
 {
 
     // Can take up to 45 seconds
 
-    this->NeoSWSerial::print("AT+COPS=?\r");
+    this->NeoSWSerial::print(F("AT+COPS=?\r"));
 
-    return _readSerialUntil(45000);
+    return _readResponse(buffer, size, 45000);
 
 }
 
-String Sim800L::getOperator()
+int Sim800L::getOperator(char* buffer, size_t size)
 {
 
-    this->NeoSWSerial::print("AT+COPS ?\r");
+    this->NeoSWSerial::print(F("AT+COPS?\r"));
 
-    return _readSerialUntil();
+    return _readResponse(buffer, size);
 
 }
 
-bool Sim800L::calculateLocation()
+/*
+ * scanOperators() keeps the operators found in list. With an EEPROM
+ * address they are saved there too, and read back here: after a reboot
+ * selectOperator() can use them without a new 45 seconds scan.
+ * The EEPROM needs 3 + size * sizeof(OperatorInfo) bytes.
+ */
+void Sim800L::setOperatorCache(OperatorInfo* list, uint8_t size, int eepromAddress)
 {
-    /*
-        Type: 1  To get longitude and latitude
-        Cid = 1  Bearer profile identifier refer to AT+SAPBR
-    */
+    _operators = list;
+    _operatorSlots = list != NULL ? size : 0;
+    _operatorCount = 0;
+    _operatorAddress = eepromAddress;
+    _loadOperators();
+}
+
+// Can take up to 45 seconds. Return the operators found, -1 on error
+int Sim800L::scanOperators()
+{
+    if (_operators == NULL) return -1;
+
+    this->NeoSWSerial::print(F("AT+COPS=?\r\n"));
 
-    uint8_t type = 1;
-    uint8_t cid = 1;
-    
-    String tmp = "AT+CIPGSMLOC=" + String(type) + "," + String(cid) + "\r\n";
-    this->NeoSWSerial::print(tmp);
-    
     /*
-    this->NeoSWSerial::print("AT+CIPGSMLOC=");
-    this->NeoSWSerial::print(type);
-    this->NeoSWSerial::print(",");
-    this->NeoSWSerial::print(cid);
-    this->NeoSWSerial::print("\r");
+     +COPS: (<stat>,"<long>","<short>","<numeric>"[,<AcT>]),(...),,(0-4),(0-2)
+     The line is longer than the buffers, every (...) is parsed when it closes,
+     the fields longer than a name are cut
     */
+    char group[OPERATOR_NAME_SIZE * 2 + 30];
+    size_t length = 0;
+    uint8_t fieldLength = 0;
+    bool inGroup = false;
+    bool quoted = false;
+    uint8_t count = 0;
+
+    uint32_t timeOld = millis();
+    _result = RESULT_TIMEOUT;
+    _rxCorrupt = false;
+    while (millis() - timeOld < OPERATOR_SCAN_TIMEOUT)
+    {
+        if (!_rxAvailable())
+        {
+            if (_rxStalled()) break;
+            continue;
+        }
+
+        char c = (char) this->NeoSWSerial::read();
+        if (c == '"') quoted = !quoted;
+        if (c == '(' && !quoted)
+        {
+            inGroup = true;
+            length = 0;
+            fieldLength = 0;
+        }
+        else if (c == ')' && !quoted && inGroup)
+        {
+            inGroup = false;
+            group[length] = '\0';
+            if (count < _operatorSlots && _parseOperator(group, _operators[count])) count++;
+        }
+        else if (inGroup && length + 1 < sizeof(group))
+        {
+            bool separator = (c == '"' || (c == ',' && !quoted));
+            if (c == ',' && !quoted) fieldLength = 0;
+            if (separator || fieldLength++ < OPERATOR_NAME_SIZE - 1) group[length++] = c;
+        }
+
+        if (_lineChar(c)) break;
+    }
+
+    _rxPause();
+    // an operator can be lost, don't save a partial list
+    if (_rxCorrupt) _result = RESULT_CORRUPT;
+    if (_result != RESULT_OK) return -1;
+
+    _operatorCount = count;
+    _saveOperators();
+    return count;
+}
+
+uint8_t Sim800L::getOperatorCount()
+{
+    return _operatorCount;
+}
+
+// Numeric MCC and MNC of the current operator (22210), 0 if not registered
+uint32_t Sim800L::getPlmn()
+{
+    // numeric format only for this query, one round trip
+    if (!_sendCommand(F("AT+COPS=3,2;+COPS?;+COPS=3,0\r\n"), "+COPS:", CMD_CLASS_QUERY)) return 0;
+
+    // +COPS: <mode>[,<format>,"<oper>"]
+    AtScanner scan(_response);
+    int32_t plmn;
+    if (!scan.find(PSTR("+COPS:")) || !scan.next(2) || !scan.skip('"') || !scan.readInt(plmn)) return 0;
+    return plmn;
+}
+
+// Register on the operator plmn (22210), 0 for the automatic selection
+bool Sim800L::selectOperator(uint32_t plmn)
+{
+    if (plmn == 0) this->NeoSWSerial::print(F("AT+COPS=0\r\n"));
+    else
+    {
+        this->NeoSWSerial::print(F("AT+COPS=1,2,\""));
+        this->NeoSWSerial::print(plmn);
+        this->NeoSWSerial::print(F("\"\r\n"));
+    }
+
+    _readSerialUntil(_response, sizeof(_response), OPERATOR_SELECT_TIMEOUT);
+    return _result == RESULT_OK;
+}
+
+#ifndef SIM800L_NO_STRING
+bool Sim800L::setMessageStorage(String value)
+{
+    return setMessageStorage(value.c_str());
+}
+
+bool Sim800L::setMessageFormat(String value)
+{
+    return setMessageFormat(value.c_str());
+}
 
-    String data = _readSerialUntil(20000);
+bool Sim800L::setClip(String value)
+{
+    return setClip(value.c_str());
+}
 
-    if (data.indexOf("ER")!=(-1)) return false;
+bool Sim800L::setPIN(String pin)
+{
+    return setPIN(pin.c_str());
+}
 
-    uint8_t indexOne;
-    uint8_t indexTwo;
+String Sim800L::getProductInfo()
+{
+    this->NeoSWSerial::print(F("ATI\r"));
+    return (_readSerialUntil());
+}
 
-    indexOne = data.indexOf(":") + 1;
-    indexTwo = data.indexOf(",");
+String Sim800L::getOperatorsList()
+{
+    this->NeoSWSerial::print(F("AT+COPS=?\r"));
+    return _readSerialUntil(45000);
+}
 
-    _locationCode = data.substring(indexOne, indexTwo);
+String Sim800L::getOperator()
+{
+    this->NeoSWSerial::print(F("AT+COPS?\r"));
+    return _readSerialUntil();
+}
+#endif
 
-    indexOne = data.indexOf(",") + 1;
-    indexTwo = data.indexOf(",", indexOne);
+bool Sim800L::calculateLocation()
+{
+    /*
+        Type: 1  To get longitude and latitude
+        Cid = 1  Bearer profile identifier refer to AT+SAPBR
+    */
 
-    _longitude = data.substring(indexOne, indexTwo);
+    this->NeoSWSerial::print(F("AT+CIPGSMLOC=1,1\r\n"));
 
-    indexOne = data.indexOf(",", indexTwo) + 1;
-    indexTwo = data.indexOf(",", indexOne);
+    _readSerialUntil(_response, sizeof(_response), LOCATION_TIMEOUT);
+    if (_result != RESULT_OK) return false;
 
-    _latitude = data.substring(indexOne, indexTwo);
+    const char* data = strstr_P(_response, PSTR("+CIPGSMLOC:"));
+    if (data == NULL) return false;
 
+    _parseLocation(data);
     return true;
 
 }
 
-String Sim800L::getLocationCode()
+int Sim800L::getLocationCode(char* buffer, size_t size)
 {
-    return _locationCode;
+    return snprintf_P(buffer, size, PSTR("%u"), _location.code);
     /*
      Location Code:
      0      Success
@@ -366,14 +442,88 @@ String Sim800L::getLocationCode()
     */
 }
 
+int Sim800L::getLongitude(char* buffer, size_t size)
+{
+    return _formatFixed(_location.longitude, buffer, size);
+}
+
+int Sim800L::getLatitude(char* buffer, size_t size)
+{
+    return _formatFixed(_location.latitude, buffer, size);
+}
+
+#ifndef SIM800L_NO_STRING
+String Sim800L::getLocationCode()
+{
+    return String(_location.code);
+}
+
 String Sim800L::getLongitude()
 {
-    return _longitude;
+    char buffer[12];
+    getLongitude(buffer, sizeof(buffer));
+    return String(buffer);
 }
 
 String Sim800L::getLatitude()
 {
-    return _latitude;
+    char buffer[12];
+    getLatitude(buffer, sizeof(buffer));
+    return String(buffer);
+}
+#endif
+
+/*
+ * Keep the last fix for ttl ms, getLocation() returns it at once and
+ * update() asks a new one in the background when it is too old or the
+ * serving cell changed. ttl 0 disables the service.
+ * The serving cell is read with AT+CENG?, it needs the engineering mode.
+ */
+bool Sim800L::setLocationService(uint32_t ttl)
+{
+    _locationTtl = ttl;
+    _cellCheckedAt = millis();
+    if (ttl == 0) return _sendCommand(F("AT+CENG=0\r\n"), NULL, CMD_CLASS_QUERY);
+    return _sendCommand(F("AT+CENG=1,0\r\n"), NULL, CMD_CLASS_QUERY);
+}
+
+/*
+ * Copy the last fix, even if it is stale: in that case a new one is
+ * asked and it replaces the cached one when update() reads it.
+ * false if there isn't any fix yet.
+ */
+bool Sim800L::getLocation(GsmLocation& location)
+{
+    location = _location;
+    if (!isLocationFresh()) _locationRefresh = true;
+    return _location.time != 0;
+}
+
+// Ask a new fix in the background, update() reads it
+bool Sim800L::refreshLocation()
+{
+    _locationRefresh = true;
+    if (_asyncTag == ASYNC_NONE) _monitorLocation();
+    return _asyncTag == ASYNC_LOCATION;
+}
+
+// true if the fix is younger than the ttl and the serving cell didn't change
+bool Sim800L::isLocationFresh()
+{
+    if (_location.time == 0) return false;
+    if (_locationTtl != 0 && getLocationAge() >= _locationTtl) return false;
+    return _location.cellId == 0 || _cellId == 0 || _location.cellId == _cellId;
+}
+
+uint32_t Sim800L::getLocationAge()
+{
+    if (_location.time == 0) return 0;
+    return millis() - _location.time;
+}
+
+uint16_t Sim800L::getCellId()
+{
+    return _cellId;
 }
 
 
@@ -381,27 +531,214 @@ String Sim800L::getLatitude()
 //PUBLIC METHODS
 //
 
-void Sim800L::reset()
+bool Sim800L::reset()
 {
     if (LED_FLAG) digitalWrite(LED_PIN,1);
 
     digitalWrite(RESET_PIN,1);
-    delay(1000);
+    delay(RESET_PULSE);
     digitalWrite(RESET_PIN,0);
-    delay(1000);
-    // wait for the module response
 
-    this->NeoSWSerial::print(F("AT\r\n"));
-    while (_readSerial().indexOf("OK")==-1 )
+    // the reset is the recovery of an open circuit breaker: the handshake
+    // probes the module at once and closes the breaker if it answers
+    if (!_available) _breakerOpenedAt = millis() - BREAKER_COOLDOWN;
+
+    uint32_t start = millis();
+    _bootStart = start;
+    _ready = 0;
+    _urcLength = 0;
+    for (uint8_t i = 0; i < BOOT_MILESTONES; i++) _bootTime[i] = 0;
+
+    // wait for the module response, bounded by the CMD_CLASS_BOOT policy.
+    // With auto-bauding the module is silent until it receives an AT.
+    // The boot URCs are handled by the line reader as they arrive
+    bool ready = _sendCommand(F("AT\r\n"), NULL, CMD_CLASS_BOOT, 500);
+
+    //wait for sms ready, in the time left of the boot deadline
+    if (ready)
     {
-        this->NeoSWSerial::print(F("AT\r\n"));
+        uint32_t deadline = _retryPolicy[CMD_CLASS_BOOT].deadline;
+        uint32_t waitStart = millis();
+        uint32_t elapsed = waitStart - start;
+        ready = elapsed < deadline && waitReady(READY_SMS, deadline - elapsed);
+        if (!ready) _commandFailed(millis() - waitStart, RESULT_TIMEOUT);
     }
 
-    //wait for sms ready
-    while (_readSerial().indexOf("SMS")==-1 );
-
     if (LED_FLAG) digitalWrite(LED_PIN,0);
 
+    return ready;
+}
+
+/*
+ * Read the unsolicited result codes received, it doesn't block.
+ * Call it in loop() to keep the readiness flags updated.
+ */
+void Sim800L::update()
+{
+    _pollAsync();
+
+    if (_linkChanged)
+    {
+        _linkChanged = false;
+        if (_linkCallback != NULL) _linkCallback(_linkGood, _rssiAverage);
+    }
+
+    // the calls not allowed are hung up when the channel is free, like the monitors
+    if (_rejectCall && _asyncTag == ASYNC_NONE && _taskOwner == NULL)
+    {
+        if (_startAsync(F("ATH\r\n"), ASYNC_HANG_UP)) _rejectCall = false;
+    }
+    _dispatchCalls();
+
+    // the monitors wait while a task holds the channel
+    if (_asyncTag == ASYNC_NONE && _taskOwner == NULL) _monitorLink();
+    if (_asyncTag == ASYNC_NONE && _taskOwner == NULL) _monitorLocation();
+}
+
+/*
+ * Every command goes through here. If update() left a command running,
+ * wait its answer first, the module doesn't take a command while it is
+ * busy with another one.
+ */
+size_t Sim800L::write(uint8_t c)
+{
+    if (_asyncTag != ASYNC_NONE) _waitAsync();
+
+    // with flow control the module holds CTS high while it can't take chars
+    if (_ctsPin != FLOW_NO_PIN)
+    {
+        uint32_t start = millis();
+        while (digitalRead(_ctsPin) == HIGH && millis() - start < FLOW_CTS_TIMEOUT);
+    }
+    return this->NeoSWSerial::write(c);
+}
+
+/*
+ * RTS/CTS hardware flow control, AT+IFC=2,2. The module sends only while
+ * the library reads: update() drops RTS when it returns, so a long answer
+ * waits in the module while the sketch is busy instead of overflowing the
+ * receive buffer. ctsPin can be FLOW_NO_PIN if only the reception is controlled
+ */
+bool Sim800L::setFlowControl(uint8_t rtsPin, uint8_t ctsPin)
+{
+    pinMode(rtsPin, OUTPUT);
+    digitalWrite(rtsPin, LOW);
+    if (!_sendCommand(F("AT+IFC=2,2\r\n"), NULL, CMD_CLASS_QUERY))
+    {
+        pinMode(rtsPin, INPUT);
+        return false;
+    }
+
+    _rtsPin = rtsPin;
+    _rxFlowing = true;
+    _ctsPin = ctsPin;
+    if (_ctsPin != FLOW_NO_PIN) pinMode(_ctsPin, INPUT);
+    _rxPause();
+    return true;
+}
+
+bool Sim800L::disableFlowControl()
+{
+    if (_rtsPin != FLOW_NO_PIN) digitalWrite(_rtsPin, LOW);
+    _ctsPin = FLOW_NO_PIN;
+    if (!_sendCommand(F("AT+IFC=0,0\r\n"), NULL, CMD_CLASS_QUERY)) return false;
+
+    if (_rtsPin != FLOW_NO_PIN) pinMode(_rtsPin, INPUT);
+    _rtsPin = FLOW_NO_PIN;
+    return true;
+}
+
+// Suspected overflows: times the receive buffer was found full. A buffer
+// just filled loses nothing, but it can't be told apart. The answers read
+// then are RESULT_CORRUPT
+uint32_t Sim800L::getRxOverflows()
+{
+    return _rxOverflows;
+}
+
+// Estimated loss, not measured: the chars the line could carry while the
+// buffer was left unread, less the room there was. NeoSWSerial doesn't count them
+uint32_t Sim800L::getRxLost()
+{
+    return _rxLost;
+}
+
+void Sim800L::resetRxStats()
+{
+    _rxOverflows = 0;
+    _rxLost = 0;
+}
+
+// true if all the subsystems (READY_SIM | READY_NETWORK ...) are ready
+bool Sim800L::isReady(uint8_t subsystems)
+{
+    return (_ready & subsystems) == subsystems;
+}
+
+bool Sim800L::waitReady(uint8_t subsystems, uint32_t timeout)
+{
+    uint32_t start = millis();
+    while (!isReady(subsystems))
+    {
+        if (millis() - start >= timeout) return false;
+        update();
+    }
+    return true;
+}
+
+// ms from the end of the reset pulse to the milestone (BOOT_RDY...), 0 if not reached
+uint32_t Sim800L::getBootTime(uint8_t milestone)
+{
+    if (milestone >= BOOT_MILESTONES) return 0;
+    return _bootTime[milestone];
+}
+
+// RESULT_OK, RESULT_ERROR or RESULT_TIMEOUT of the last command
+uint8_t Sim800L::getLastResult()
+{
+    return _result;
+}
+
+/*
+ * Every command class has its own policy: max attempts, exponential backoff
+ * between attempts (backoff, 2*backoff... up to maxBackoff) and an overall
+ * deadline. Call it after begin(), begin() loads the defaults.
+ */
+void Sim800L::setRetryPolicy(uint8_t commandClass, RetryPolicy policy)
+{
+    if (commandClass >= CMD_CLASS_COUNT) return;
+    if (policy.attempts == 0) policy.attempts = 1;
+    _retryPolicy[commandClass] = policy;
+}
+
+RetryPolicy Sim800L::getRetryPolicy(uint8_t commandClass)
+{
+    if (commandClass >= CMD_CLASS_COUNT) commandClass = CMD_CLASS_QUERY;
+    return _retryPolicy[commandClass];
+}
+
+// false while the circuit breaker is open
+bool Sim800L::isAvailable()
+{
+    return _available;
+}
+
+// ms from the first failed command to the next successful one, of the last recovery
+uint32_t Sim800L::getRecoveryTime()
+{
+    return _recoveryTime;
+}
+
+// ms spent waiting answers of attempts that failed
+uint32_t Sim800L::getWastedSerialTime()
+{
+    return _wastedSerialTime;
+}
+
+void Sim800L::resetRetryMetrics()
+{
+    _recoveryTime = 0;
+    _wastedSerialTime = 0;
 }
 
 void Sim800L::setPhoneFunctionality()
@@ -417,7 +754,7 @@ void Sim800L::setPhoneFunctionality()
 }
 
 
-String Sim800L::signalQuality()
+int Sim800L::signalQuality(char* buffer, size_t size)
 {
     /*Response
     +CSQ: <rssi>,<ber>Parameters
@@ -432,44 +769,153 @@ String Sim800L::signalQuality()
     subclause 7.2.4
     99 Not known or not detectable
     */
+    this->NeoSWSerial::print (F("AT+CSQ\r\n"));
+    return _readResponse(buffer, size);
+}
+
+#ifndef SIM800L_NO_STRING
+String Sim800L::signalQuality()
+{
     this->NeoSWSerial::print (F("AT+CSQ\r\n"));
     return(_readSerialUntil());
 }
+#endif
 
 
-void Sim800L::activateBearerProfile()
+/*
+ * Sample AT+CSQ, AT+CREG? and AT+CGREG? every interval ms from update(),
+ * without blocking. 0 disables the monitor.
+ */
+void Sim800L::setLinkMonitor(uint32_t interval)
 {
-    this->NeoSWSerial::print (F(" AT+SAPBR=3,1,\"CONTYPE\",\"GPRS\" \r\n" ));
-    String _buffer=_readSerial();  // set bearer parameter
-    this->NeoSWSerial::print (F(" AT+SAPBR=3,1,\"APN\",\"internet\" \r\n" ));
-    _buffer=_readSerial();  // set apn
-    this->NeoSWSerial::print (F(" AT+SAPBR=1,1 \r\n"));
-    delay(1200);
-    _buffer=_readSerial();          // activate bearer context
-    this->NeoSWSerial::print (F(" AT+SAPBR=2,1\r\n "));
-    delay(3000);
-    _buffer=_readSerial();          // get context ip address
+    _linkInterval = interval;
+    _linkStep = 0;
+    _linkLastSample = millis() - interval;      // first sample in the next update()
 }
 
-
-void Sim800L::deactivateBearerProfile()
+// callback is called when the link changes between good and bad
+void Sim800L::onLinkChange(int8_t threshold, LinkCallback callback)
 {
-    this->NeoSWSerial::print (F("AT+SAPBR=0,1\r\n "));
-    delay(1500);
+    _linkThreshold = threshold;
+    _linkCallback = callback;
+    _linkGood = false;
+    _linkChanged = false;
+    _checkLink();
 }
 
+// dBm of the last sample, RSSI_UNKNOWN if not detectable
+int8_t Sim800L::getRssi()
+{
+    return _rssi;
+}
 
+// moving average of the last LINK_SAMPLES samples, in dBm
+int8_t Sim800L::getRssiAverage()
+{
+    return _rssiAverage;
+}
 
-bool Sim800L::answerCall()
+// change of the average in the last sample, dB
+int8_t Sim800L::getRssiTrend()
 {
-    this->NeoSWSerial::print (F("ATA\r\n"));
-    //Response in case of data call, if successfully connected
-    String _buffer=_readSerialUntil();
-    if ( (_buffer.indexOf("ER")) == -1)
+    return _rssiTrend;
+}
+
+// 0...7 RXQUAL, 99 not known
+uint8_t Sim800L::getBer()
+{
+    return _ber;
+}
+
+/*
+ * <stat> of +CREG and +CGREG
+ * 0 not registered, not searching
+ * 1 registered, home network
+ * 2 not registered, searching
+ * 3 registration denied
+ * 4 unknown
+ * 5 registered, roaming
+ */
+uint8_t Sim800L::getRegistration()
+{
+    return _registration;
+}
+
+uint8_t Sim800L::getGprsRegistration()
+{
+    return _gprsRegistration;
+}
+
+
+/*
+ * Read several independent queries in one command line, like
+ * AT+CSQ;+CREG?;+CPAS;+CCLK?;+CBC, the answers are split by their prefix.
+ * If the module rejects the line, the queries are sent one by one.
+ * With pipeline false they are always sent one by one, to compare.
+ */
+bool Sim800L::readStatus(StatusSnapshot& status, uint8_t queries, bool pipeline)
+{
+    uint32_t start = millis();
+    memset(&status, 0, sizeof(status));
+    status.rssi = RSSI_UNKNOWN;
+    _snapshot = &status;
+
+    if (pipeline)
     {
-        return false;
+        this->NeoSWSerial::print(F("AT"));
+        bool first = true;
+        for (uint8_t query = 1; query <= STATUS_CBC; query <<= 1)
+        {
+            if (!(queries & query)) continue;
+            if (!first) this->NeoSWSerial::print(';');
+            _printStatusQuery(query);
+            first = false;
+        }
+        this->NeoSWSerial::print(F("\r\n"));
+        _readSerialUntil(_response, sizeof(_response));
+        status.roundTrips = 1;
+    }
+
+    if (!pipeline || _result != RESULT_OK)
+    {
+        status.valid = 0;
+        for (uint8_t query = 1; query <= STATUS_CBC; query <<= 1)
+        {
+            if (!(queries & query)) continue;
+            this->NeoSWSerial::print(F("AT"));
+            _printStatusQuery(query);
+            this->NeoSWSerial::print(F("\r\n"));
+            _readSerialUntil(_response, sizeof(_response));
+            status.roundTrips++;
+        }
     }
-    else return true;
+
+    _snapshot = NULL;
+    status.elapsed = millis() - start;
+    return (status.valid & queries) == queries;
+}
+
+void Sim800L::activateBearerProfile()
+{
+    ModemTask task;
+    startBearer(task);
+    _runBlocking(task);
+}
+
+
+void Sim800L::deactivateBearerProfile()
+{
+    this->NeoSWSerial::print (F("AT+SAPBR=0,1\r\n "));
+    delay(1500);
+}
+
+
+
+bool Sim800L::answerCall()
+{
+    this->NeoSWSerial::print (F("ATA\r\n"));
+    //Response in case of data call, if successfully connected
+    return _commandError();
     // Error found, return 1
     // Error NOT found, return 0
 }
@@ -480,12 +926,7 @@ bool Sim800L::callNumber(char* number)
     this->NeoSWSerial::print (F("ATD"));
     this->NeoSWSerial::print (number);
     this->NeoSWSerial::print (F(";\r\n"));
-	String _buffer=_readSerialUntil();
-    if ( (_buffer.indexOf("ER")) == -1)
-    {
-        return false;
-    }
-    else return true;
+    return _commandError();
     // Error found, return 1
     // Error NOT found, return 0
 }
@@ -503,9 +944,25 @@ uint8_t Sim800L::getCallStatus()
      4 Call in progress
 
     */
+    if (_callReports)
+    {
+        // the +CLCC reports already tell it, no need to ask
+        uint8_t status = 0;
+        for (uint8_t i = 0; i < CALL_SLOTS; i++)
+        {
+            if (_calls[i].id == 0 || _calls[i].state == CALL_DISCONNECTED) continue;
+            if (_calls[i].state != CALL_INCOMING && _calls[i].state != CALL_WAITING) return 4;
+            status = 3;
+        }
+        return status;
+    }
+
     this->NeoSWSerial::print (F("AT+CPAS\r\n"));
-    String _buffer=_readSerialUntil();
-    return _buffer.substring(_buffer.indexOf("+CPAS: ")+7,_buffer.indexOf("+CPAS: ")+9).toInt();
+    _readSerialUntil(_response, sizeof(_response));
+    AtScanner scan(_response);
+    int32_t status;
+    if (!scan.find(PSTR("+CPAS:")) || !scan.readInt(status)) return 2;
+    return status;
 
 }
 
@@ -514,38 +971,75 @@ uint8_t Sim800L::getCallStatus()
 bool Sim800L::hangoffCall()
 {
     this->NeoSWSerial::print (F("ATH\r\n"));
-    String _buffer=_readSerialUntil();
-    if ( (_buffer.indexOf("ER")) == -1)
-    {
-        return false;
-    }
-    else return true;
+    return _commandError();
     // Error found, return 1
     // Error NOT found, return 0
 }
 
+/*
+ * Follow the calls with the +CLCC reports, RING, +CLIP, NO CARRIER, BUSY
+ * and NO ANSWER instead of polling getCallStatus(). update() calls
+ * callback for every change of state, the last one is CALL_DISCONNECTED.
+ */
+bool Sim800L::onCallChange(CallCallback callback)
+{
+    _callCallback = callback;
+    _callReports = _sendCommand(F("AT+CLCC=1\r\n"), NULL, CMD_CLASS_QUERY);
+    return _callReports;
+}
+
+// update() calls callback for every key (0-9, *, #, A-D) detected in the call
+bool Sim800L::onDtmf(DtmfCallback callback)
+{
+    _dtmfCallback = callback;
+    return _sendCommand(F("AT+DDET=1\r\n"), NULL, CMD_CLASS_QUERY);
+}
+
+uint8_t Sim800L::getCallCount()
+{
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < CALL_SLOTS; i++)
+    {
+        if (_calls[i].id != 0 && _calls[i].state != CALL_DISCONNECTED) count++;
+    }
+    return count;
+}
+
+// Copy the index-th call in progress, false if there aren't so many
+bool Sim800L::getCall(uint8_t index, CallInfo& call)
+{
+    for (uint8_t i = 0; i < CALL_SLOTS; i++)
+    {
+        if (_calls[i].id == 0 || _calls[i].state == CALL_DISCONNECTED) continue;
+        if (index-- > 0) continue;
+
+        call = _calls[i];
+        if (call.connected != 0) call.duration = millis() - call.connected;
+        return true;
+    }
+    return false;
+}
+
 
 bool Sim800L::sendSms(char* number,char* text)
 {
 
     // Can take up to 60 seconds
 
-    this->NeoSWSerial::print (F("AT+CMGF=1\r"));     //set sms to text mode
-    String _buffer=_readSerialUntil();
-    if ((_buffer.indexOf("ER")) == -1)
+    if (_sendCommand(F("AT+CMGF=1\r"), NULL, CMD_CLASS_SMS))     //set sms to text mode
     {
         this->NeoSWSerial::print (F("AT+CMGS=\""));      // command to send sms
         this->NeoSWSerial::print (number);
         this->NeoSWSerial::print(F("\"\r"));
-        _buffer=_readSerial();
+        _readSerial(_response, sizeof(_response));
         this->NeoSWSerial::print (text);
         this->NeoSWSerial::print ("\r");
-        _buffer=_readSerial();
+        _readSerial(_response, sizeof(_response));
         this->NeoSWSerial::print((char)26);
-        _buffer=_readSerialUntil(60000);
+        _readSerialUntil(_response, sizeof(_response), 60000);
         //expect CMGS:xxx   , where xxx is a number,for the sending sms.
-        if (_buffer.indexOf("CMGS:") != -1)
-        //if ( (_buffer.indexOf("ER")) == -1)
+        //The OK after it is checked, the echo of a long text can push CMGS out of the buffer
+        if (_result == RESULT_OK)
         {
             // IS OK
             return false;
@@ -558,77 +1052,296 @@ bool Sim800L::sendSms(char* number,char* text)
 }
 
 
-String Sim800L::getNumberSms(uint8_t index)
+int Sim800L::getNumberSms(uint8_t index, char* buffer, size_t size)
 {
-    String _buffer=readSms(index);
-    //Serial.println(_buffer.length());
-    if (_buffer.length() > 10) //avoid empty sms
+    // +CMGR: <stat>,<oa>,<alpha>,<scts>, only the header is needed
+    if (readSms(index, _response, sizeof(_response)) > 10) //avoid empty sms
     {
-        uint8_t _idx1=_buffer.indexOf("+CMGR:");
-        _idx1=_buffer.indexOf("\",\"",_idx1+1);
-        return _buffer.substring(_idx1+3,_buffer.indexOf("\",\"",_idx1+4));
+        const char* header = strstr_P(_response, PSTR("+CMGR:"));
+        return _copyField(header, 1, buffer, size);
     }
     else
     {
-        return "";
+        return _copyString("", buffer, size);
     }
 }
 
 
 
+int Sim800L::readSms(uint8_t index, char* buffer, size_t size)
+{
+
+    // Can take up to 5 seconds
+
+    if (_sendCommand(F("AT+CMGF=1\r"), NULL, CMD_CLASS_SMS))
+    {
+        this->NeoSWSerial::print (F("AT+CMGR="));
+        this->NeoSWSerial::print (index);
+        this->NeoSWSerial::print ("\r");
+        int length = _readSerialUntil(buffer, size);
+        if (strstr_P(buffer, PSTR("CMGR:")) != NULL)
+        {
+            _setSmsSlot(index, true, false);
+            return length;
+        }
+        if (_result == RESULT_OK) _setSmsSlot(index, false, false);
+        return _copyString("", buffer, size);
+    }
+    else {
+        _copyString("ERROR", buffer, size);
+        return -1;
+    }
+}
+
+#ifndef SIM800L_NO_STRING
+String Sim800L::getNumberSms(uint8_t index)
+{
+    char number[24];
+    getNumberSms(index, number, sizeof(number));
+    return String(number);
+}
+
 String Sim800L::readSms(uint8_t index)
 {
 
     // Can take up to 5 seconds
 
-    this->NeoSWSerial::print (F("AT+CMGF=1\r"));
-	String _buffer = _readSerialUntil();
-    if (( _buffer.indexOf("ER")) ==-1)
+    if (_sendCommand(F("AT+CMGF=1\r"), NULL, CMD_CLASS_SMS))
     {
         this->NeoSWSerial::print (F("AT+CMGR="));
         this->NeoSWSerial::print (index);
         this->NeoSWSerial::print ("\r");
-        _buffer=_readSerialUntil();
+        String _buffer=_readSerialUntil();
         if (_buffer.indexOf("CMGR:")!=-1)
         {
+            _setSmsSlot(index, true, false);
             return _buffer;
         }
-        else return "";
+        if (_result == RESULT_OK) _setSmsSlot(index, false, false);
+        return "";
     }
     else {
         return "ERROR";
     }
 }
 
-void Sim800L::readSmsReference(uint8_t index, String& buffer, int max=1000)
+void Sim800L::readSmsReference(uint8_t index, String& buffer, int max)
 {
 
     // Can take up to 5 seconds
 
-    this->NeoSWSerial::print (F("AT+CMGF=1\r"));
-	_readSerialUntilReference(buffer, max);
-    if (( buffer.indexOf("ER")) ==-1)
+    if (_sendCommand(F("AT+CMGF=1\r"), NULL, CMD_CLASS_SMS))
     {
         this->NeoSWSerial::print (F("AT+CMGR="));
         this->NeoSWSerial::print (index);
         this->NeoSWSerial::print ("\r");
 		buffer = "";
         _readSerialUntilReference(buffer, max);
-        if (buffer.indexOf("CMGR:")!=-1)
+        if (buffer.indexOf("CMGR:")==-1)
         {
-            return buffer;
-        }
-        else {
 			buffer = "";
-			return "";
+            if (_result == RESULT_OK) _setSmsSlot(index, false, false);
 		}
+        else _setSmsSlot(index, true, false);
     }
     else {
 		buffer = "ERROR";
-        return "ERROR";
     }
 }
+#endif
+
+
+/*
+ * Accept sms and calls only from the numbers of list, a PROGMEM string
+ * with the patterns separated by '\0':
+ *   const char allowed[] PROGMEM = "+39333*\0+3934712345??\0";
+ * '?' matches any char and a final '*' any end, a prefix. The numbers are
+ * matched char by char while the header arrives: readSmsStream() skips
+ * the body of the other senders and the calls are marked not allowed.
+ * actions: ALLOW_DELETE_SMS | ALLOW_HANG_UP.
+ * The +CMT of onSms() are matched the same way, the bodies of the other
+ * senders are dropped. NULL removes the list. false if there are more than ALLOW_LIST_MAX.
+ */
+bool Sim800L::setAllowList(const char* list, uint8_t actions)
+{
+    uint8_t count = 0;
+    for (const char* pattern = list; pattern != NULL && pgm_read_byte(pattern) != '\0'; pattern += strlen_P(pattern) + 1)
+    {
+        if (++count > ALLOW_LIST_MAX) return false;
+    }
+
+    _allowList = count > 0 ? list : NULL;
+    _allowCount = count;
+    _allowActions = actions;
+    return true;
+}
+
+bool Sim800L::isAllowed(const char* number)
+{
+    _allowStart();
+    for (; *number != '\0'; number++) _allowChar(*number);
+    return _allowMatched();
+}
+
+/*
+ * Read the sms without buffering it: the header is parsed and passed to
+ * onHeader, the body is passed to onChunk in chunks of SMS_CHUNK_SIZE chars
+ * as it arrives. Return the length of the body, 0 if the slot is empty,
+ * -1 if error or timeout, SMS_REJECTED if the sender isn't in the allow-list.
+ */
+int Sim800L::readSmsStream(uint8_t index, SmsHeaderCallback onHeader, SmsChunkCallback onChunk, uint32_t timeout)
+{
+    // the body ends with an empty line and OK
+    static const char end[] = "\r\n\r\nOK\r\n";
+    const uint8_t endLength = sizeof(end) - 1;
+
+    if (!_sendCommand(F("AT+CMGF=1\r"), NULL, CMD_CLASS_SMS)) return -1;
+
+    this->NeoSWSerial::print (F("AT+CMGR="));
+    this->NeoSWSerial::print (index);
+    this->NeoSWSerial::print ("\r");
+
+    // header: the echo and the URCs go to the line reader until the +CMGR line
+    uint32_t timeOld = millis();
+    uint8_t length = 0;
+    uint8_t field = 0;
+    bool quoted = false;
+    _result = RESULT_TIMEOUT;
+    _rxCorrupt = false;
+    _urcLength = 0;
+    _allowStart();
+
+    while (true)
+    {
+        if (millis() - timeOld >= timeout)
+        {
+            _rxPause();
+            return -1;
+        }
+        if (!_rxAvailable())
+        {
+            if (!_rxStalled()) continue;
+            _result = RESULT_CORRUPT;
+            _rxPause();
+            return -1;
+        }
+
+        char c = (char) this->NeoSWSerial::read();
+        if (c == '\n')
+        {
+            _response[length] = '\0';
+            if (length > 0 && strncmp_P(_response, PSTR("+CMGR:"), 6) == 0)
+            {
+                // the header isn't a URC
+                _urcLength = 0;
+                break;
+            }
+        }
+        else if (c != '\r')
+        {
+            if (length < sizeof(_response) - 1) _response[length++] = c;
+
+            // the sender, field 1 of +CMGR, is matched while it arrives
+            if (c == '"') quoted = !quoted;
+            else if (c == ',' && !quoted) field++;
+            else if (field == 1) _allowChar(c);
+        }
+
+        // a URC can match its own number, the header starts after it
+        bool final = _lineChar(c);
+        if (c == '\n')
+        {
+            length = 0;
+            field = 0;
+            quoted = false;
+            _allowStart();
+        }
+        if (!final) continue;
+
+        _rxPause();
+        if (_rxCorrupt) _result = RESULT_CORRUPT;
+        if (_result != RESULT_OK) return -1;
+        _setSmsSlot(index, false, false);
+        return 0;       // empty slot
+    }
+
+    _setSmsSlot(index, true, false);
+
+    bool allowed = _allowMatched();
+    bool deliver = allowed;
+    if (allowed && onHeader != NULL)
+    {
+        SmsHeader header;
+        _copyField(_response, 0, header.status, sizeof(header.status));
+        _copyField(_response, 1, header.number, sizeof(header.number));
+        _copyField(_response, 3, header.timestamp, sizeof(header.timestamp));
+        deliver = onHeader(header);
+    }
+
+    // body: the last chars are held in tail until it is sure they aren't the end
+    char chunk[SMS_CHUNK_SIZE];
+    char tail[sizeof(end) - 1];
+    uint8_t chunkLength = 0;
+    uint8_t tailLength = 0;
+    int bodyLength = 0;
+
+    while (millis() - timeOld < timeout)
+    {
+        if (!_rxAvailable())
+        {
+            if (_rxStalled()) break;
+            continue;
+        }
+
+        char c = (char) this->NeoSWSerial::read();
+        if (tailLength == endLength)
+        {
+            // the body of a sender not allowed is only counted
+            if (deliver) chunk[chunkLength++] = tail[0];
+            bodyLength++;
+            memmove(tail, tail + 1, endLength - 1);
+            tailLength--;
+            if (chunkLength == SMS_CHUNK_SIZE)
+            {
+                if (deliver && onChunk != NULL) onChunk(chunk, chunkLength);
+                chunkLength = 0;
+            }
+        }
+        tail[tailLength++] = c;
+
+        if (tailLength == endLength && memcmp(tail, end, endLength) == 0)
+        {
+            if (deliver && onChunk != NULL && chunkLength > 0) onChunk(chunk, chunkLength);
+            if (_rxCorrupt) break;
+            _result = RESULT_OK;
+            _rxPause();
+            if (allowed) return bodyLength;
+
+            if (_allowActions & ALLOW_DELETE_SMS) delSms(index, 0);
+            return SMS_REJECTED;
+        }
+    }
+
+    _rxPause();
+    if (_rxCorrupt) _result = RESULT_CORRUPT;
+    return -1;
+}
 
+/*
+ * Deliver the sms with +CMT instead of storing them (AT+CNMI=2,2): update()
+ * passes the header to onHeader and the text to onChunk, a chunk of length
+ * 0 ends it. The senders not in the allow-list are dropped. The callbacks
+ * run inside the line reader, they can't send commands. With onChunk NULL
+ * the sms are stored again and told by +CMTI.
+ */
+bool Sim800L::onSms(SmsHeaderCallback onHeader, SmsChunkCallback onChunk)
+{
+    _smsHeaderCallback = onHeader;
+    _smsChunkCallback = onChunk;
+    if (!_sendCommand(F("AT+CMGF=1\r"), NULL, CMD_CLASS_SMS)) return false;
+    if (onChunk == NULL) return _sendCommand(F("AT+CNMI=2,1,0,0,0\r"), NULL, CMD_CLASS_SMS);
+    return _sendCommand(F("AT+CNMI=2,2,0,0,0\r"), NULL, CMD_CLASS_SMS);
+}
 
 bool Sim800L::delSms(uint8_t index, uint8_t option)
 {
@@ -639,12 +1352,21 @@ bool Sim800L::delSms(uint8_t index, uint8_t option)
 	this->NeoSWSerial::print (",");
 	this->NeoSWSerial::print (option);
 	this->NeoSWSerial::print ("\r");
-    String _buffer=_readSerialUntil(25000);
-    if ( (_buffer.indexOf("ER")) == -1)
+    if (_commandError(25000)) return true;
+
+    /*
+     option 0 the sms at index
+            1 all read, 2 read and sent, 3 read, sent and unsent
+            4 all
+     With 1 and 2 the stored sms that survive are seen again by syncSmsSlots()
+    */
+    if (option == 0) _setSmsSlot(index, false, false);
+    else if (option == 4) _clearSmsSlots();
+    else
     {
-        return false;
+        for (uint8_t i = 0; i < sizeof(_smsUsed); i++) _smsUsed[i] &= _smsNew[i];
     }
-    else return true;
+    return false;
     // Error found, return 1
     // Error NOT found, return 0
 }
@@ -654,165 +1376,1705 @@ bool Sim800L::delAllSms()
     // Can take up to 25 seconds
 
     this->NeoSWSerial::print(F("at+cmgda=\"del all\"\n\r"));
-    String _buffer=_readSerialUntil(25000);
-    if ( (_buffer.indexOf("ER")) == -1)
-    {
-        return false;
-    }
-    else return true;
+    if (_commandError(25000)) return true;
+
+    _clearSmsSlots();
+    return false;
     // Error found, return 1
     // Error NOT found, return 0
 }
 
-
-void Sim800L::RTCtime(int *day,int *month, int *year,int *hour,int *minute, int *second)
+/*
+ * Load the sms slot index from the module: the capacity from AT+CPMS? and
+ * the occupied slots from AT+CMGL (mode 1, it doesn't mark them as read).
+ * After it the index is kept updated by +CMTI, readSms and delSms, call it
+ * once after reset().
+ */
+bool Sim800L::syncSmsSlots()
 {
-    this->NeoSWSerial::print(F("at+cclk?\r\n"));
-    // if respond with ERROR try one more time.
-    String _buffer=_readSerial();
-    if ((_buffer.indexOf("ERR"))!=-1)
-    {
-        delay(50);
-        this->NeoSWSerial::print(F("at+cclk?\r\n"));
-    }
-    if ((_buffer.indexOf("ERR"))==-1)
+    // +CPMS: <mem1>,<used1>,<total1>,<mem2>...
+    if (!_sendCommand(F("AT+CPMS?\r\n"), "+CPMS:", CMD_CLASS_SMS)) return false;
+
+    AtScanner scan(_response);
+    int32_t total;
+    if (scan.find(PSTR("+CPMS:")) && scan.next(2) && scan.readInt(total)) _smsCapacity = total;
+
+    if (!_sendCommand(F("AT+CMGF=1\r"), NULL, CMD_CLASS_SMS)) return false;
+
+    _clearSmsSlots();
+    this->NeoSWSerial::print(F("AT+CMGL=\"ALL\",1\r"));
+
+    /*
+     +CMGL: <index>,<stat>,<oa>,<alpha>,<scts>
+     <text>
+     only the headers are parsed, the text that follows each one is skipped:
+     it can look like a header or a result code
+    */
+    uint32_t timeOld = millis();
+    uint8_t length = 0;
+    bool text = false;
+    _result = RESULT_TIMEOUT;
+    _rxCorrupt = false;
+
+    while (millis() - timeOld < 20000)
     {
-        _buffer=_buffer.substring(_buffer.indexOf("\"")+1,_buffer.lastIndexOf("\"")-1);
-        *year=_buffer.substring(0,2).toInt();
-        *month= _buffer.substring(3,5).toInt();
-        *day=_buffer.substring(6,8).toInt();
-        *hour=_buffer.substring(9,11).toInt();
-        *minute=_buffer.substring(12,14).toInt();
-        *second=_buffer.substring(15,17).toInt();
+        if (!_rxAvailable())
+        {
+            if (_rxStalled()) break;
+            continue;
+        }
+
+        char c = (char) this->NeoSWSerial::read();
+        if (c == '\r') continue;
+        if (c != '\n')
+        {
+            if (!text && length < sizeof(_response) - 1) _response[length++] = c;
+            continue;
+        }
+        if (text)
+        {
+            text = false;
+            continue;
+        }
+        if (length == 0) continue;
+        _response[length] = '\0';
+        length = 0;
+
+        if (strncmp_P(_response, PSTR("+CMGL:"), 6) == 0)
+        {
+            AtScanner scan(_response);
+            int32_t index;
+            if (scan.find(PSTR("+CMGL:")) && scan.readInt(index)) _setSmsSlot(index, true, strstr_P(_response, PSTR("UNREAD")) != NULL);
+            text = true;
+        }
+        else if (strcmp_P(_response, PSTR("OK")) == 0)
+        {
+            _result = RESULT_OK;
+            break;
+        }
+        else if (strstr_P(_response, PSTR("ERROR")) != NULL)
+        {
+            _result = RESULT_ERROR;
+            break;
+        }
+        else _handleUrc(_response);
     }
+
+    _rxPause();
+    if (_rxCorrupt) _result = RESULT_CORRUPT;
+    return _result == RESULT_OK;
 }
 
-//Get the time  of the base of GSM
-String Sim800L::dateNet()
+bool Sim800L::isSmsSlotUsed(uint8_t index)
 {
-    this->NeoSWSerial::print(F("AT+CIPGSMLOC=2,1\r\n "));
-    String _buffer=_readSerial();
+    if (index == 0 || index > SMS_SLOTS) return false;
+    index--;
+    return _smsUsed[index / 8] & (1 << (index % 8));
+}
+
+bool Sim800L::isSmsNew(uint8_t index)
+{
+    if (index == 0 || index > SMS_SLOTS) return false;
+    index--;
+    return _smsNew[index / 8] & (1 << (index % 8));
+}
 
-    if (_buffer.indexOf("OK")!=-1 )
+// First unread sms from the index from, 0 if there isn't any
+uint8_t Sim800L::nextNewSms(uint8_t from)
+{
+    if (from == 0) from = 1;
+    for (uint8_t index = from; index <= SMS_SLOTS; index++)
     {
-        return _buffer.substring(_buffer.indexOf(":")+2,(_buffer.indexOf("OK")-4));
+        if (isSmsNew(index)) return index;
     }
-    else
-        return "0";
+    return 0;
 }
 
-// Update the RTC of the module with the date of GSM.
-bool Sim800L::updateRtc(int utc)
+uint8_t Sim800L::getSmsCount()
 {
+    uint8_t count = 0;
+    for (uint8_t index = 1; index <= SMS_SLOTS; index++)
+    {
+        if (isSmsSlotUsed(index)) count++;
+    }
+    return count;
+}
 
-    activateBearerProfile();
-    String _buffer=dateNet();
-    deactivateBearerProfile();
+// Slots of the storage reported by AT+CPMS?, 0 before syncSmsSlots()
+uint8_t Sim800L::getSmsCapacity()
+{
+    return _smsCapacity;
+}
 
-    _buffer=_buffer.substring(_buffer.indexOf(",")+1,_buffer.length());
-    String dt=_buffer.substring(0,_buffer.indexOf(","));
-    String tm=_buffer.substring(_buffer.indexOf(",")+1,_buffer.length()) ;
 
-    int hour = tm.substring(0,2).toInt();
-    int day = dt.substring(8,10).toInt();
+bool Sim800L::RTCtime(int *day,int *month, int *year,int *hour,int *minute, int *second)
+{
+    int values[6];
+    if (!_readRtc(values, NULL)) return false;
+
+    *year=values[0];
+    *month=values[1];
+    *day=values[2];
+    *hour=values[3];
+    *minute=values[4];
+    *second=values[5];
+    return true;
+}
 
-    hour=hour+utc;
+//Get the time  of the base of GSM
+int Sim800L::dateNet(char* buffer, size_t size)
+{
+    this->NeoSWSerial::print(F("AT+CIPGSMLOC=2,1\r\n "));
+    _readSerialUntil(_response, sizeof(_response), 20000);
 
-    String tmp_hour;
-    String tmp_day;
-    //TODO : fix if the day is 0, this occur when day is 1 then decrement to 1,
-    //       will need to check the last month what is the last day .
-    if (hour<0)
+    // +CIPGSMLOC: <locationcode>,<date>,<time>
+    const char* data = strstr_P(_response, PSTR("+CIPGSMLOC: "));
+    if (_result != RESULT_OK || data == NULL)
     {
-        hour+=24;
-        day-=1;
+        _copyString("0", buffer, size);
+        return -1;
     }
-    if (hour<10)
-    {
 
-        tmp_hour="0"+String(hour);
-    }
-    else
-    {
-        tmp_hour=String(hour);
-    }
-    if (day<10)
-    {
-        tmp_day="0"+String(day);
-    }
-    else
-    {
-        tmp_day=String(day);
-    }
-    //for debugging
-    //Serial.println("at+cclk=\""+dt.substring(2,4)+"/"+dt.substring(5,7)+"/"+tmp_day+","+tmp_hour+":"+tm.substring(3,5)+":"+tm.substring(6,8)+"-03\"\r\n");
-    this->NeoSWSerial::print("at+cclk=\""+dt.substring(2,4)+"/"+dt.substring(5,7)+"/"+tmp_day+","+tmp_hour+":"+tm.substring(3,5)+":"+tm.substring(6,8)+"-03\"\r\n");
-    if ( (_readSerial().indexOf("ER"))!=-1)
+    data += 12;
+    uint8_t length = strcspn(data, "\r\n");
+    if (size > 0)
     {
-        return true;
+        uint8_t stored = length < size ? length : size - 1;
+        memcpy(buffer, data, stored);
+        buffer[stored] = '\0';
     }
-    else return false;
+    return length;
+}
 
+#ifndef SIM800L_NO_STRING
+String Sim800L::dateNet()
+{
+    char date[32];
+    dateNet(date, sizeof(date));
+    return String(date);
+}
+#endif
 
+// Update the RTC of the module with the date of GSM.
+bool Sim800L::updateRtc(int utc)
+{
+    ModemTask task;
+    startUpdateRtc(task, utc);
+    return !_runBlocking(task);
+    // Error found, return 1
+    // Error NOT found, return 0
 }
 
+/*
+ * AT+CLTS=1 The module takes the time from the network (NITZ) when it
+ * registers and updates the RTC with it, no GPRS bearer is needed.
+ * AT&W saves it, it is applied in the next boot.
+ */
+bool Sim800L::enableNetworkTime()
+{
+    this->NeoSWSerial::print(F("AT+CLTS=1\r\n"));
+    if (_commandError()) return false;
 
+    this->NeoSWSerial::print(F("AT&W\r\n"));
+    return !_commandError();
+}
 
-//
-//NO MORE PRIVATE METHODS
-//
-String Sim800L::_readSerialUntil(uint32_t timeout = TIME_OUT_READ_SERIAL)
+// true when the network sent the time in this boot, *PSUTTZ URC
+bool Sim800L::isNetworkTimeSynced()
 {
+    return _networkTime;
+}
 
-    uint64_t timeOld = millis();
-    String str;
+// Time zone of the network, in quarters of hour (-12 is UTC-3)
+int8_t Sim800L::getTimeZone()
+{
+    return _timeZone;
+}
 
-    while (!str.endsWith("OK\r\n") && !str.endsWith("ERROR\r\n") && !(millis() > timeOld + timeout))
+// Unix time (UTC) of the RTC, 0 if it can't be read
+uint32_t Sim800L::getEpoch()
+{
+    int values[6];
+    int8_t zone;
+    if (!_readRtc(values, &zone)) return 0;
+
+    // the RTC keeps the local time
+    return _toEpoch(2000 + values[0], values[1], values[2], values[3], values[4], values[5]) - (int32_t) zone * 900;
+}
+
+// Set the RTC with the local time of epoch (UTC) in the time zone, quarters of hour
+bool Sim800L::setRtc(uint32_t epoch, int8_t timeZone)
+{
+    _printRtc(epoch, timeZone);
+
+    if (_commandError()) return false;
+    _timeZone = timeZone;
+    return true;
+}
+
+/*
+ * Tasks: multi-step flows that run a step at a time in loop(), several
+ * of them can interleave. A task takes the command channel for each
+ * command, after a prompt it keeps it until the next answer.
+ */
+void Sim800L::startTask(ModemTask& task, TaskFunction function, void* data)
+{
+    taskRelease(task);
+    memset(&task, 0, sizeof(task));
+    task.function = function;
+    task.data = data;
+    task.status = TASK_RUNNING;
+    task.result = RESULT_TIMEOUT;
+}
+
+// Run a step of the task, return its TASK_* status. The cost of the step is measured
+int8_t Sim800L::runTask(ModemTask& task)
+{
+    _pollAsync();
+    if (task.status != TASK_RUNNING || task.function == NULL) return task.status;
+
+    uint32_t start = micros();
+    int8_t status = task.function(*this, task);
+    uint32_t cost = micros() - start;
+
+    task.steps++;
+    task.lastCost = cost;
+    task.totalCost += cost;
+    if (cost > task.maxCost) task.maxCost = cost;
+
+    if (status != TASK_RUNNING)
+    {
+        task.status = status;
+        taskRelease(task);
+    }
+    return status;
+}
+
+/*
+ * Run the tasks in turn, starting after the last one run, while the
+ * last cost of the next one fits in the budget (us). The first always runs.
+ * Return how many tasks are still running
+ */
+uint8_t Sim800L::runTasks(ModemTask** tasks, uint8_t count, uint32_t budget)
+{
+    uint32_t start = micros();
+    uint8_t running = 0;
+    bool first = true;
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        uint8_t index = (_taskNext + i) % count;
+        ModemTask* task = tasks[index];
+        if (task->status != TASK_RUNNING) continue;
+
+        if (first || micros() - start + task->lastCost <= budget)
+        {
+            runTask(*task);
+            _taskNext = index + 1;
+            first = false;
+        }
+        if (task->status == TASK_RUNNING) running++;
+    }
+    return running;
+}
+
+// true if the task holds the command channel, it's free when nothing else is running
+bool Sim800L::taskAcquire(ModemTask& task)
+{
+    if (_taskOwner == &task) return _asyncTag == ASYNC_NONE;
+    if (_taskOwner != NULL || _asyncTag != ASYNC_NONE || !_breakerAllows()) return false;
+
+    _taskOwner = &task;
+    return true;
+}
+
+void Sim800L::taskRelease(ModemTask& task)
+{
+    if (_taskOwner == &task) _taskOwner = NULL;
+}
+
+// The task sent a command on its own, wait the answer (or the "> " prompt) in the background
+void Sim800L::taskExpect(ModemTask& task, uint32_t timeout, bool prompt)
+{
+    _response[0] = '\0';
+    _asyncTag = prompt ? ASYNC_PROMPT : ASYNC_TASK;
+    _asyncSince = millis();
+    _asyncTimeout = timeout;
+    _result = RESULT_TIMEOUT;
+    _rxCorrupt = false;
+    _taskWaiting = &task;
+    task.result = RESULT_PENDING;
+}
+
+bool Sim800L::taskCommand(ModemTask& task, const __FlashStringHelper* command, uint32_t timeout)
+{
+    return taskCommand(task, command, NULL, NULL, timeout);
+}
+
+/*
+ * Send command, text and end when the channel is free, then true when the
+ * answer arrived: task.result has the RESULT_*, getTaskAnswer() the lines.
+ * Call it again until it returns true, TASK_COMMAND does it
+ */
+bool Sim800L::taskCommand(ModemTask& task, const __FlashStringHelper* command, const char* text, const __FlashStringHelper* end,
+                          uint32_t timeout, bool prompt)
+{
+    if (!task.sent)
+    {
+        if (!taskAcquire(task)) return false;
+
+        if (command != NULL) this->NeoSWSerial::print(command);
+        if (text != NULL) this->NeoSWSerial::print(text);
+        if (end != NULL) this->NeoSWSerial::print(end);
+        taskExpect(task, timeout, prompt);
+        task.sent = true;
+        return false;
+    }
+    if (task.result == RESULT_PENDING) return false;
+
+    task.sent = false;
+    // after a prompt the channel is kept for the text
+    if (!prompt || task.result != RESULT_OK) taskRelease(task);
+    return true;
+}
+
+// The lines of the last task command, before the final result code
+const char* Sim800L::getTaskAnswer()
+{
+    return _response;
+}
+
+// Send an sms in text mode, like sendSms() but without blocking
+void Sim800L::startSendSms(ModemTask& task, const char* number, const char* text)
+{
+    startTask(task, _sendSmsTask);
+    task.text[0] = number;
+    task.text[1] = text;
+}
+
+void Sim800L::startBearer(ModemTask& task, const char* apn)
+{
+    startTask(task, _bearerTask);
+    task.text[0] = apn;
+}
+
+// Open the bearer, read the date of GSM, close the bearer and set the RTC, like updateRtc()
+void Sim800L::startUpdateRtc(ModemTask& task, int utc)
+{
+    startTask(task, _updateRtcTask);
+    task.text[0] = "internet";
+    task.value[1] = utc;
+}
+
+int8_t Sim800L::_sendSmsTask(Sim800L& gsm, ModemTask& task)
+{
+    TASK_BEGIN(task);
+
+    TASK_COMMAND(gsm, task, F("AT+CMGF=1\r"));       //set sms to text mode
+    if (task.result != RESULT_OK) TASK_FAIL(task);
+
+    TASK_COMMAND(gsm, task, F("AT+CMGS=\""), task.text[0], F("\"\r"), TIME_OUT_READ_SERIAL, true);
+    if (task.result != RESULT_OK) TASK_FAIL(task);
+
+    // +CMGS and OK can take up to 60 seconds
+    TASK_COMMAND(gsm, task, NULL, task.text[1], F("\x1a"), 60000);
+    if (task.result != RESULT_OK) TASK_FAIL(task);
+
+    TASK_END(task);
+}
+
+int8_t Sim800L::_bearerTask(Sim800L& gsm, ModemTask& task)
+{
+    TASK_BEGIN(task);
+
+    // the parameters can fail if the bearer is already open, it's checked at the end
+    TASK_COMMAND(gsm, task, F("AT+SAPBR=3,1,\"CONTYPE\",\"GPRS\"\r\n"));
+    TASK_COMMAND(gsm, task, F("AT+SAPBR=3,1,\"APN\",\""), task.text[0], F("\"\r\n"));
+    TASK_COMMAND(gsm, task, F("AT+SAPBR=1,1\r\n"), 85000);
+
+    // +SAPBR: 1,<status>,<ip>, 1 connected
+    TASK_COMMAND(gsm, task, F("AT+SAPBR=2,1\r\n"));
+    {
+        AtScanner scan(gsm._response);
+        int status;
+        if (task.result != RESULT_OK || !scan.find(PSTR("+SAPBR:")) || !scan.next() ||
+            !scan.readDigits(1, status) || status != 1) TASK_FAIL(task);
+    }
+
+    TASK_END(task);
+}
+
+int8_t Sim800L::_updateRtcTask(Sim800L& gsm, ModemTask& task)
+{
+    // the bearer first, then this flow from its start. The date is asked
+    // even if the bearer failed, the bearer is closed anyway
+    if (task.stage == 0)
+    {
+        if (_bearerTask(gsm, task) == TASK_RUNNING) return TASK_RUNNING;
+        task.stage = 1;
+        task.line = 0;
+    }
+
+    TASK_BEGIN(task);
+
+    TASK_COMMAND(gsm, task, F("AT+CIPGSMLOC=2,1\r\n"), LOCATION_TIMEOUT);
+    task.value[0] = (int32_t) gsm._parseNetDate(gsm._response);
+    TASK_COMMAND(gsm, task, F("AT+SAPBR=0,1\r\n"), 65000);
+    if (task.value[0] == 0) TASK_FAIL(task);
+
+    TASK_WAIT_UNTIL(task, gsm.taskAcquire(task));
+    gsm._printRtc((uint32_t) task.value[0], task.value[1] * 4);
+    gsm.taskExpect(task);
+    TASK_WAIT_UNTIL(task, task.result != RESULT_PENDING);
+    gsm.taskRelease(task);
+    if (task.result != RESULT_OK) TASK_FAIL(task);
+    gsm._timeZone = task.value[1] * 4;
+
+    TASK_END(task);
+}
+
+
+
+//
+//PRIVATE METHODS
+//
+
+// The state of the library, the same for every begin()
+void Sim800L::_init()
+{
+    _sleepMode = 0;
+    _functionalityMode = 1;
+
+    if (LED_FLAG) pinMode(LED_PIN, OUTPUT);
+
+    _initRetry();
+
+    _ready = 0;
+    _urcLength = 0;
+    _bootStart = millis();
+    for (uint8_t i = 0; i < BOOT_MILESTONES; i++) _bootTime[i] = 0;
+
+    _clearSmsSlots();
+    _smsCapacity = 0;
+
+    _asyncTag = ASYNC_NONE;
+    _linkInterval = 0;
+    _linkStep = 0;
+    _rssi = RSSI_UNKNOWN;
+    _ber = 99;
+    _registration = 0;
+    _gprsRegistration = 0;
+    _rssiCount = 0;
+    _rssiIndex = 0;
+    _rssiAverage = RSSI_UNKNOWN;
+    _rssiTrend = 0;
+    _linkGood = false;
+    _linkChanged = false;
+    _linkCallback = NULL;
+
+    _timeZone = 0;
+    _networkTime = false;
+    _snapshot = NULL;
+
+    _allowList = NULL;
+    _allowCount = 0;
+    _allowActions = 0;
+    _bodyLine = false;
+    _cmtSender = 0;
+    _smsDeliver = false;
+    _smsHeaderCallback = NULL;
+    _smsChunkCallback = NULL;
+    _rejectCall = false;
+
+    _operators = NULL;
+    _operatorSlots = 0;
+    _operatorCount = 0;
+    _operatorAddress = -1;
+
+    memset(&_location, 0, sizeof(_location));
+    _locationTtl = 0;
+    _locationRefresh = false;
+    _cellId = 0;
+    _cellCheckedAt = 0;
+
+    memset(_calls, 0, sizeof(_calls));
+    _callEventCount = 0;
+    _callEndReason = CALL_END_NONE;
+    _callReports = false;
+    _callCallback = NULL;
+    _dtmfCount = 0;
+    _dtmfCallback = NULL;
+
+    _taskOwner = NULL;
+    _taskWaiting = NULL;
+    _taskNext = 0;
+
+    _rtsPin = FLOW_NO_PIN;
+    _ctsPin = FLOW_NO_PIN;
+    _rxFlowing = false;
+    _rxFull = false;
+    _rxCorrupt = false;
+    _rxLastCount = 0;
+    _rxCheckedAt = micros();
+    _rxLastChar = 0;
+    _rxOverflows = 0;
+    _rxLost = 0;
+}
+
+void Sim800L::_printRtc(uint32_t epoch, int8_t timeZone)
+{
+    int values[6];
+    _fromEpoch(epoch + (int32_t) timeZone * 900, values);
+
+    // at+cclk="yy/MM/dd,hh:mm:ss+zz"
+    this->NeoSWSerial::print(F("at+cclk=\""));
+    _printTwoDigits(values[0] % 100);
+    this->NeoSWSerial::print('/');
+    _printTwoDigits(values[1]);
+    this->NeoSWSerial::print('/');
+    _printTwoDigits(values[2]);
+    this->NeoSWSerial::print(',');
+    _printTwoDigits(values[3]);
+    this->NeoSWSerial::print(':');
+    _printTwoDigits(values[4]);
+    this->NeoSWSerial::print(':');
+    _printTwoDigits(values[5]);
+    this->NeoSWSerial::print(timeZone < 0 ? '-' : '+');
+    _printTwoDigits(timeZone < 0 ? -timeZone : timeZone);
+    this->NeoSWSerial::print(F("\"\r\n"));
+}
+
+// Unix time of "+CIPGSMLOC: <locationcode>,yyyy/MM/dd,hh:mm:ss" (UTC), 0 if it isn't there
+uint32_t Sim800L::_parseNetDate(const char* text)
+{
+    AtScanner scan(text);
+    int year, month, day, hour, minute, second;
+    if (!scan.find(PSTR("+CIPGSMLOC:")) || !scan.next() || !scan.readDigits(4, year) || !scan.skip('/') ||
+        !scan.readDigits(2, month) || !scan.skip('/') || !scan.readDigits(2, day) || !scan.skip(',') ||
+        !scan.readDigits(2, hour) || !scan.skip(':') || !scan.readDigits(2, minute) || !scan.skip(':') ||
+        !scan.readDigits(2, second)) return 0;
+
+    return _toEpoch(year, month, day, hour, minute, second);
+}
+
+// Run the task to its end, false if it failed, a task holds the channel
+// or the circuit breaker is open: its commands would wait the cooldown
+bool Sim800L::_runBlocking(ModemTask& task)
+{
+    if (_taskOwner != NULL || !_breakerAllows()) return false;
+    while (runTask(task) == TASK_RUNNING);
+    return task.status == TASK_DONE;
+}
+
+// Keep a line of the answer of a task command in _response, '\n' separated
+void Sim800L::_appendAnswer(const char* line)
+{
+    size_t length = strlen(_response);
+    if (length > 0 && length < sizeof(_response) - 1) _response[length++] = '\n';
+    strncpy(_response + length, line, sizeof(_response) - 1 - length);
+    _response[sizeof(_response) - 1] = '\0';
+}
+void Sim800L::_initRetry()
+{
+    RetryPolicy policy;
+    policy.attempts   = RETRY_DEFAULT_ATTEMPTS;
+    policy.backoff    = RETRY_DEFAULT_BACKOFF;
+    policy.maxBackoff = RETRY_DEFAULT_MAX_BACKOFF;
+    policy.deadline   = RETRY_DEFAULT_DEADLINE;
+
+    for (uint8_t i = 0; i < CMD_CLASS_COUNT; i++) _retryPolicy[i] = policy;
+
+    // the module can take some seconds to sync the baud rate and to be sms ready
+    _retryPolicy[CMD_CLASS_BOOT].attempts   = 10;
+    _retryPolicy[CMD_CLASS_BOOT].maxBackoff = 1000;
+    _retryPolicy[CMD_CLASS_BOOT].deadline   = 20000;
+
+    _failures = 0;
+    _available = true;
+    _breakerOpenedAt = 0;
+    _failing = false;
+    _failingSince = 0;
+    _recoveryTime = 0;
+    _wastedSerialTime = 0;
+}
+
+// Send the command until the response contains expected (or OK if expected is NULL),
+// following the policy of the class. The response is left in _response
+bool Sim800L::_sendCommand(const __FlashStringHelper* command, const char* expected, uint8_t commandClass, uint32_t timeout)
+{
+    if (!_breakerAllows()) return false;
+
+    RetryPolicy policy = getRetryPolicy(commandClass);
+    uint32_t start = millis();
+    uint32_t backoff = policy.backoff;
+    uint32_t wasted = 0;
+
+    for (uint8_t attempt = 1; ; attempt++)
+    {
+        uint32_t attemptStart = millis();
+        uint32_t left = policy.deadline - (attemptStart - start);
+
+        this->NeoSWSerial::print(command);
+        _readSerialUntil(_response, sizeof(_response), timeout < left ? timeout : left);
+        if (expected == NULL ? _result == RESULT_OK : strstr(_response, expected) != NULL)
+        {
+            _wastedSerialTime += wasted;
+            _commandSucceeded();
+            return true;
+        }
+        wasted += millis() - attemptStart;
+        _markFailing(attemptStart);
+
+        if (attempt >= policy.attempts) break;
+        if (millis() - start + backoff >= policy.deadline) break;
+        delay(backoff);
+        backoff = backoff * 2 < policy.maxBackoff ? backoff * 2 : policy.maxBackoff;
+    }
+
+    _commandFailed(wasted, _result);
+    return false;
+}
+
+void Sim800L::_handleUrc(const char* line)
+{
+    if (strcmp_P(line, PSTR("RDY")) == 0)
+    {
+        _bootMilestone(BOOT_RDY);
+    }
+    else if (strncmp_P(line, PSTR("+CFUN: "), 7) == 0)
+    {
+        AtScanner scan(line + 7);
+        int32_t fun;
+        if (scan.readInt(fun)) _functionalityMode = fun;
+        _bootMilestone(BOOT_CFUN);
+    }
+    else if (strncmp_P(line, PSTR("+CPIN: "), 7) == 0)
+    {
+        if (strcmp_P(line + 7, PSTR("READY")) == 0)
+        {
+            _ready |= READY_SIM;
+            _bootMilestone(BOOT_CPIN);
+        }
+        else _ready &= ~READY_SIM;      // SIM PIN, NOT INSERTED...
+    }
+    else if (strcmp_P(line, PSTR("Call Ready")) == 0)
+    {
+        _ready |= READY_NETWORK;
+        _bootMilestone(BOOT_CALL_READY);
+    }
+    else if (strcmp_P(line, PSTR("SMS Ready")) == 0)
+    {
+        _ready |= READY_SMS;
+        _bootMilestone(BOOT_SMS_READY);
+    }
+    else if (strncmp_P(line, PSTR("+CREG: "), 7) == 0 || strncmp_P(line, PSTR("+CGREG: "), 8) == 0)
+    {
+        /*
+         URC      +CREG: <stat>[,<lac>,<ci>]
+         Response +CREG: <n>,<stat>[,<lac>,<ci>]
+         <stat> 1 registered home network, 5 registered roaming
+        */
+        bool gprs = line[1] == 'C' && line[2] == 'G';
+        AtScanner scan(line);
+        int32_t stat, second;
+        if (!scan.skipTo(':') || !scan.readInt(stat)) return;
+        if (scan.skip(',') && scan.readInt(second)) stat = second;     // the lac is quoted
+
+        uint8_t flag = gprs ? READY_GPRS : READY_NETWORK;
+        if (stat == 1 || stat == 5) _ready |= flag;
+        else _ready &= ~flag;
+
+        if (gprs) _gprsRegistration = stat;
+        else
+        {
+            _registration = stat;
+            _checkLink();
+            if (_snapshot != NULL)
+            {
+                _snapshot->registration = _registration;
+                _snapshot->valid |= STATUS_CREG;
+            }
+        }
+    }
+    else if (strncmp_P(line, PSTR("+CSQ: "), 6) == 0)
+    {
+        // +CSQ: <rssi>,<ber>
+        AtScanner scan(line + 6);
+        int32_t csq, ber;
+        if (!scan.readInt(csq)) return;
+        if (scan.skip(',') && scan.readInt(ber)) _ber = ber;
+        _addRssiSample(csq);
+        if (_snapshot != NULL)
+        {
+            _snapshot->rssi = _rssi;
+            _snapshot->ber = _ber;
+            _snapshot->valid |= STATUS_CSQ;
+        }
+    }
+    else if (_asyncTag == ASYNC_LOCATION && strncmp_P(line, PSTR("+CIPGSMLOC: "), 12) == 0)
+    {
+        _parseLocation(line);
+    }
+    else if (strncmp_P(line, PSTR("+CENG: 0,\""), 10) == 0)
+    {
+        _parseCell(line);
+    }
+    else if (_snapshot != NULL && strncmp_P(line, PSTR("+CPAS: "), 7) == 0)
+    {
+        AtScanner scan(line + 7);
+        int32_t activity;
+        if (!scan.readInt(activity)) return;
+        _snapshot->activity = activity;
+        _snapshot->valid |= STATUS_CPAS;
+    }
+    else if (_snapshot != NULL && strncmp_P(line, PSTR("+CCLK: "), 7) == 0)
+    {
+        int values[6];
+        int8_t zone;
+        if (_parseClock(line, values, &zone))
+        {
+            _snapshot->epoch = _toEpoch(2000 + values[0], values[1], values[2], values[3], values[4], values[5]) - (int32_t) zone * 900;
+            _snapshot->valid |= STATUS_CCLK;
+        }
+    }
+    else if (_snapshot != NULL && strncmp_P(line, PSTR("+CBC: "), 6) == 0)
+    {
+        // +CBC: <bcs>,<bcl>,<voltage>
+        AtScanner scan(line + 6);
+        int32_t level, voltage;
+        if (!scan.next() || !scan.readInt(level) || !scan.skip(',') || !scan.readInt(voltage)) return;
+        _snapshot->batteryLevel = level;
+        _snapshot->batteryVoltage = voltage;
+        _snapshot->valid |= STATUS_CBC;
+    }
+    else if (strncmp_P(line, PSTR("*PSUTTZ: "), 9) == 0)
+    {
+        // *PSUTTZ: <year>,<month>,<day>,<hour>,<min>,<sec>,"<tz>",<dst>
+        // with AT+CLTS=1 the module updates the RTC with it
+        AtScanner scan(line + 9);
+        int32_t zone;
+        if (!scan.next(6) || !scan.skip('"') || !scan.readInt(zone)) return;
+        _timeZone = zone;
+        _networkTime = true;
+    }
+    else if (strncmp_P(line, PSTR("+CTZV: "), 7) == 0)
+    {
+        // +CTZV: <tz>[,<dst>]
+        AtScanner scan(line + 7);
+        int32_t zone;
+        scan.skip('"');
+        if (scan.readInt(zone)) _timeZone = zone;
+    }
+    else if (strncmp_P(line, PSTR("+CMTI: "), 7) == 0)
+    {
+        // +CMTI: <mem>,<index>   new sms stored
+        AtScanner scan(line + 7);
+        int32_t index;
+        if (scan.next() && scan.readInt(index)) _setSmsSlot(index, true, true);
+    }
+    else if (strncmp_P(line, PSTR("+CLCC: "), 7) == 0)
+    {
+        // +CLCC: <id>,<dir>,<stat>,<mode>,<mpty>[,<number>,<type>]
+        AtScanner scan(line + 7);
+        int32_t id, direction, state;
+        if (!scan.readInt(id) || !scan.skip(',') || !scan.readInt(direction) ||
+            !scan.skip(',') || !scan.readInt(state)) return;
+        CallInfo* call = _findCall(id, true);
+        if (call == NULL) return;
+
+        call->incoming = (direction == 1);
+        call->allowed = !call->incoming || _allowList == NULL;     // also for a withheld number
+        char number[CALL_NUMBER_SIZE];
+        if (scan.next(3) && scan.readField(number, sizeof(number)) > 0)
+        {
+            _copyString(number, call->number, sizeof(call->number));
+            call->allowed = !call->incoming || isAllowed(number);
+            if (!call->allowed && state == CALL_INCOMING && (_allowActions & ALLOW_HANG_UP)) _rejectCall = true;
+        }
+        _setCallState(call, state);
+    }
+    else if (strcmp_P(line, PSTR("RING")) == 0)
+    {
+        // without +CLCC the ring is the only sign of an incoming call
+        for (uint8_t i = 0; i < CALL_SLOTS; i++)
+        {
+            if (_calls[i].id != 0 && (_calls[i].state == CALL_INCOMING || _calls[i].state == CALL_WAITING)) return;
+        }
+        CallInfo* call = _findCall(1, true);
+        if (call == NULL || call->state != CALL_IDLE) return;
+        call->incoming = true;
+        call->allowed = _allowList == NULL;     // until +CLIP tells the number
+        _setCallState(call, CALL_INCOMING);
+    }
+    else if (strncmp_P(line, PSTR("+CLIP: "), 7) == 0)
+    {
+        // +CLIP: <number>,<type>...   after every RING
+        for (uint8_t i = 0; i < CALL_SLOTS; i++)
+        {
+            if (_calls[i].id == 0 || _calls[i].state != CALL_INCOMING) continue;
+            _copyField(line, 0, _calls[i].number, sizeof(_calls[i].number));
+            _calls[i].allowed = isAllowed(_calls[i].number);
+            if (!_calls[i].allowed && (_allowActions & ALLOW_HANG_UP)) _rejectCall = true;
+        }
+    }
+    else if (strcmp_P(line, PSTR("NO CARRIER")) == 0)
+    {
+        _endCalls(CALL_END_NORMAL);
+    }
+    else if (strcmp_P(line, PSTR("BUSY")) == 0)
+    {
+        _endCalls(CALL_END_BUSY);
+    }
+    else if (strcmp_P(line, PSTR("NO ANSWER")) == 0)
+    {
+        _endCalls(CALL_END_NO_ANSWER);
+    }
+    else if (strncmp_P(line, PSTR("+DTMF: "), 7) == 0)
+    {
+        if (_dtmfCount < DTMF_QUEUE) _dtmf[_dtmfCount++] = line[7];
+    }
+    else if (strstr_P(line, PSTR("POWER DOWN")) != NULL)
+    {
+        _ready = 0;
+    }
+}
+
+// The slot of the call id, a new one if create. NULL if all are busy
+CallInfo* Sim800L::_findCall(uint8_t id, bool create)
+{
+    if (id == 0) return NULL;
+
+    CallInfo* free = NULL;
+    for (uint8_t i = 0; i < CALL_SLOTS; i++)
+    {
+        if (_calls[i].id == id && _calls[i].state != CALL_DISCONNECTED) return &_calls[i];
+        if (_calls[i].id == 0 && free == NULL) free = &_calls[i];
+    }
+    if (!create || free == NULL) return NULL;
+
+    memset(free, 0, sizeof(CallInfo));
+    free->id = id;
+    free->state = CALL_IDLE;
+    free->start = millis();
+    return free;
+}
+
+// Queue the transition, update() passes it to the callback
+void Sim800L::_setCallState(CallInfo* call, uint8_t state)
+{
+    uint8_t previous = call->state;
+    if (state > CALL_DISCONNECTED || state == previous) return;
+
+    call->state = state;
+    if (state == CALL_ACTIVE && call->connected == 0) call->connected = millis();
+    if (state == CALL_DISCONNECTED)
+    {
+        if (call->connected != 0) call->duration = millis() - call->connected;
+        call->endReason = _callEndReason != CALL_END_NONE ? _callEndReason : CALL_END_NORMAL;
+    }
+
+    if (_callEventCount < CALL_EVENTS)
+    {
+        _callEvents[_callEventCount++] = ((call - _calls) << 6) | (previous << 3) | state;
+    }
+}
+
+/*
+ * NO CARRIER, BUSY and NO ANSWER don't say which call ended: with the
+ * +CLCC reports they only give the reason of the one that ends, without
+ * them every call is over.
+ */
+void Sim800L::_endCalls(uint8_t reason)
+{
+    for (uint8_t i = 0; i < CALL_SLOTS; i++)
+    {
+        if (_calls[i].id == 0) continue;
+        if (_calls[i].state == CALL_DISCONNECTED) _calls[i].endReason = reason;
+        else
+        {
+            // for the +CLCC that ends it
+            _callEndReason = reason;
+            if (!_callReports) _setCallState(&_calls[i], CALL_DISCONNECTED);
+        }
+    }
+}
+
+void Sim800L::_dispatchCalls()
+{
+    // the callbacks can send commands, the events they cause are queued behind
+    while (_callEventCount > 0)
+    {
+        uint8_t event = _callEvents[0];
+        _callEventCount--;
+        memmove(_callEvents, _callEvents + 1, _callEventCount);
+
+        CallInfo call = _calls[event >> 6];
+        call.state = event & 0x07;
+        if (call.state != CALL_DISCONNECTED)
+        {
+            call.endReason = CALL_END_NONE;
+            if (call.connected != 0) call.duration = millis() - call.connected;
+        }
+        if (_callCallback != NULL) _callCallback(call, (event >> 3) & 0x07);
+    }
+
+    for (uint8_t i = 0; i < CALL_SLOTS; i++)
+    {
+        if (_calls[i].id != 0 && _calls[i].state == CALL_DISCONNECTED)
+        {
+            _calls[i].id = 0;
+            _callEndReason = CALL_END_NONE;
+        }
+    }
+
+    while (_dtmfCount > 0)
+    {
+        char key = _dtmf[0];
+        _dtmfCount--;
+        memmove(_dtmf, _dtmf + 1, _dtmfCount);
+        if (_dtmfCallback != NULL) _dtmfCallback(key);
+    }
+}
+
+void Sim800L::_bootMilestone(uint8_t milestone)
+{
+    if (_bootTime[milestone] == 0) _bootTime[milestone] = millis() - _bootStart;
+}
+
+// Send a command without waiting the answer, update() reads it
+bool Sim800L::_startAsync(const __FlashStringHelper* command, uint8_t tag, uint32_t timeout)
+{
+    if (_asyncTag != ASYNC_NONE || !_breakerAllows()) return false;
+
+    this->NeoSWSerial::print(command);
+
+    _asyncTag = tag;
+    _asyncSince = millis();
+    _asyncTimeout = timeout;
+    _result = RESULT_TIMEOUT;
+    _rxCorrupt = false;
+    return true;
+}
+
+// Read what is available, the answers are parsed by _handleUrc
+void Sim800L::_pollAsync()
+{
+    // with flow control the module sends only while RTS is asserted,
+    // an answer running is read for a slice of time
+    uint32_t start = millis();
+    uint32_t lastChar = start;
+    while (true)
+    {
+        if (!_rxAvailable())
+        {
+            if (_rtsPin == FLOW_NO_PIN || _asyncTag == ASYNC_NONE) break;
+            if (millis() - lastChar >= FLOW_GAP || millis() - start >= FLOW_SLICE) break;
+            continue;
+        }
+        lastChar = millis();
+
+        char c = (char) this->NeoSWSerial::read();
+        if (c == '>' && _asyncTag == ASYNC_PROMPT)
+        {
+            // the prompt has no line end
+            _urcLength = 0;
+            _result = RESULT_OK;
+            _finishAsync();
+        }
+        else if (_lineChar(c) && _asyncTag != ASYNC_NONE) _finishAsync();
+    }
+    if (_asyncTag != ASYNC_NONE && (millis() - _asyncSince >= _asyncTimeout || _rxStalled())) _finishAsync();
+
+    // the sketch runs until the next poll, the module keeps what it has to send
+    _rxPause();
+}
+
+void Sim800L::_waitAsync()
+{
+    while (_asyncTag != ASYNC_NONE) _pollAsync();
+}
+
+void Sim800L::_finishAsync()
+{
+    uint8_t tag = _asyncTag;
+    _asyncTag = ASYNC_NONE;
+    if (_rxCorrupt) _result = RESULT_CORRUPT;
+
+    if (_result == RESULT_OK) _commandSucceeded();
+    else _commandFailed(millis() - _asyncSince, _result);
+
+    if (_taskWaiting != NULL)
+    {
+        _taskWaiting->result = _result;
+        _taskWaiting = NULL;
+    }
+    if (tag == ASYNC_LINK) _linkStep++;
+    if (tag == ASYNC_CELL) _cellCheckedAt = millis();
+    // read the serving cell of a new fix at once
+    if (tag == ASYNC_LOCATION && _location.cellId == 0) _cellCheckedAt = millis() - LOCATION_CELL_INTERVAL;
+}
+
+void Sim800L::_monitorLink()
+{
+    if (_linkInterval == 0) return;
+
+    switch (_linkStep)
+    {
+    case 0:
+        if (millis() - _linkLastSample < _linkInterval) return;
+        _linkLastSample = millis();
+        _startAsync(F("AT+CSQ\r\n"), ASYNC_LINK);
+        break;
+    case 1:
+        _startAsync(F("AT+CREG?\r\n"), ASYNC_LINK);
+        break;
+    case 2:
+        _startAsync(F("AT+CGREG?\r\n"), ASYNC_LINK);
+        break;
+    default:
+        _linkStep = 0;
+        break;
+    }
+}
+
+void Sim800L::_allowStart()
+{
+    _allowAlive = _allowCount < 32 ? (1UL << _allowCount) - 1 : 0xFFFFFFFFUL;
+    _allowPrefix = 0;
+    _allowPosition = 0;
+}
+
+// One char of the number: drop the patterns that don't match it
+void Sim800L::_allowChar(char c)
+{
+    if (_allowList == NULL || _allowAlive == 0) return;
+
+    const char* pattern = _allowList;
+    for (uint8_t i = 0; i < _allowCount; i++)
+    {
+        uint32_t bit = 1UL << i;
+        if (_allowAlive & bit)
+        {
+            char p = pgm_read_byte(pattern + _allowPosition);
+            if (p == '*') _allowPrefix |= bit;
+            if (p == '*' || (p != c && p != '?')) _allowAlive &= ~bit;
+        }
+        pattern += strlen_P(pattern) + 1;
+    }
+    if (_allowPosition < 255) _allowPosition++;
+}
+
+// The number is over: allowed if a prefix matched or a pattern ends here
+bool Sim800L::_allowMatched()
+{
+    if (_allowList == NULL || _allowPrefix != 0) return true;
+
+    const char* pattern = _allowList;
+    for (uint8_t i = 0; i < _allowCount; i++)
+    {
+        if (_allowAlive & (1UL << i))
+        {
+            char p = pgm_read_byte(pattern + _allowPosition);
+            if (p == '\0' || p == '*') return true;
+        }
+        pattern += strlen_P(pattern) + 1;
+    }
+    return false;
+}
+
+// <stat>,"<long>","<short>","<numeric>"[,<AcT>]
+bool Sim800L::_parseOperator(const char* text, OperatorInfo& info)
+{
+    AtScanner scan(text);
+    int32_t status, plmn, accessTechnology = 0;
+    char numeric[8];
+
+    if (!scan.readInt(status) || !scan.skip(',')) return false;
+    if (scan.readField(info.longName, sizeof(info.longName)) < 0 || !scan.skip(',')) return false;
+    if (scan.readField(info.shortName, sizeof(info.shortName)) < 0 || !scan.skip(',')) return false;
+    if (scan.readField(numeric, sizeof(numeric)) <= 0) return false;
+    if (scan.skip(',')) scan.readInt(accessTechnology);
+
+    AtScanner number(numeric);
+    if (!number.readInt(plmn)) return false;
+
+    info.status = status;
+    info.plmn = plmn;
+    info.accessTechnology = accessTechnology;
+    return true;
+}
+
+void Sim800L::_saveOperators()
+{
+    if (_operatorAddress < 0) return;
+
+    // the size of the record invalidates the data of an older layout
+    EEPROM.update(_operatorAddress, OPERATOR_MAGIC);
+    EEPROM.update(_operatorAddress + 1, sizeof(OperatorInfo));
+    EEPROM.update(_operatorAddress + 2, _operatorCount);
+    for (uint8_t i = 0; i < _operatorCount; i++)
+    {
+        EEPROM.put(_operatorAddress + 3 + i * sizeof(OperatorInfo), _operators[i]);
+    }
+}
+
+void Sim800L::_loadOperators()
+{
+    if (_operatorAddress < 0 || _operators == NULL) return;
+    if (EEPROM.read(_operatorAddress) != OPERATOR_MAGIC) return;
+    if (EEPROM.read(_operatorAddress + 1) != sizeof(OperatorInfo)) return;
+
+    uint8_t count = EEPROM.read(_operatorAddress + 2);
+    if (count > _operatorSlots) count = _operatorSlots;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        EEPROM.get(_operatorAddress + 3 + i * sizeof(OperatorInfo), _operators[i]);
+    }
+    _operatorCount = count;
+}
+
+void Sim800L::_monitorLocation()
+{
+    if (_locationRefresh)
+    {
+        if (_startAsync(F("AT+CIPGSMLOC=1,1\r\n"), ASYNC_LOCATION, LOCATION_TIMEOUT)) _locationRefresh = false;
+    }
+    else if (_locationTtl != 0 && _location.time != 0 && millis() - _cellCheckedAt >= LOCATION_CELL_INTERVAL)
+    {
+        _startAsync(F("AT+CENG?\r\n"), ASYNC_CELL);
+    }
+}
+
+// +CIPGSMLOC: <locationcode>,<longitude>,<latitude>,<date>,<time>
+void Sim800L::_parseLocation(const char* data)
+{
+    AtScanner scan(data);
+    int32_t code, longitude, latitude;
+    if (!scan.skipTo(':') || !scan.readInt(code)) return;
+    _location.code = code;
+    if (code != 0) return;
+
+    if (!scan.skip(',') || !scan.readFixed(longitude, 6) || !scan.skip(',') || !scan.readFixed(latitude, 6)) return;
+    _location.longitude = longitude;
+    _location.latitude = latitude;
+    _location.cellId = 0;         // the next AT+CENG? sets it
+    _location.time = millis();
+    if (_location.time == 0) _location.time = 1;
+}
+
+// +CENG: 0,"<arfcn>,<rxl>,<rxq>,<mcc>,<mnc>,<bsic>,<cellid>,<rla>,<txp>,<lac>,<TA>"
+void Sim800L::_parseCell(const char* line)
+{
+    AtScanner scan(line);
+    uint32_t cell;
+    if (!scan.skipTo('"') || !scan.next(6) || !scan.readHex(cell)) return;
+    if (cell == 0 || cell >= 0xFFFF) return;
+    _cellId = cell;
+    if (_location.time == 0) return;
+    if (_location.cellId == 0) _location.cellId = cell;
+    else if (_location.cellId != cell) _locationRefresh = true;
+}
+
+int Sim800L::_formatFixed(int32_t value, char* buffer, size_t size)
+{
+    uint32_t magnitude = value < 0 ? -(uint32_t) value : value;
+    return snprintf_P(buffer, size, PSTR("%s%lu.%06lu"), value < 0 ? "-" : "",
+                      (unsigned long) (magnitude / 1000000UL), (unsigned long) (magnitude % 1000000UL));
+}
+
+void Sim800L::_addRssiSample(uint8_t csq)
+{
+    /*
+     0 -115 dBm or less, 1 -111 dBm, 2...30 -110... -54 dBm
+     31 -52 dBm or greater, 99 not known or not detectable
+    */
+    if (csq == 99 || csq > 31)
     {
-        while(this->NeoSWSerial::available())
+        _rssi = RSSI_UNKNOWN;
+        return;
+    }
+    if (csq == 0) _rssi = -115;
+    else if (csq == 1) _rssi = -111;
+    else if (csq == 31) _rssi = -52;
+    else _rssi = -110 + (csq - 2) * 2;
+
+    _rssiSamples[_rssiIndex] = _rssi;
+    _rssiIndex = (_rssiIndex + 1) % LINK_SAMPLES;
+    if (_rssiCount < LINK_SAMPLES) _rssiCount++;
+
+    int16_t sum = 0;
+    for (uint8_t i = 0; i < _rssiCount; i++) sum += _rssiSamples[i];
+    int8_t average = sum / _rssiCount;
+
+    _rssiTrend = _rssiAverage == RSSI_UNKNOWN ? 0 : average - _rssiAverage;
+    _rssiAverage = average;
+    _checkLink();
+}
+
+// The callback is called later by update(), not in the middle of another command
+void Sim800L::_checkLink()
+{
+    if (_linkCallback == NULL) return;
+
+    bool registered = _registration == 1 || _registration == 5;
+    bool good = registered && _rssiAverage != RSSI_UNKNOWN && _rssiAverage >= _linkThreshold;
+    if (good == _linkGood) return;
+
+    _linkGood = good;
+    _linkChanged = true;
+}
+
+// Read the RTC, values: yy, MM, dd, hh, mm, ss. zone in quarters of hour
+bool Sim800L::_readRtc(int* values, int8_t* zone)
+{
+    // if respond with ERROR try again, as the CMD_CLASS_QUERY policy says
+    if (!_sendCommand(F("at+cclk?\r\n"), "+CCLK:", CMD_CLASS_QUERY)) return false;
+
+    return _parseClock(strstr_P(_response, PSTR("+CCLK:")), values, zone);
+}
+
+bool Sim800L::_parseClock(const char* text, int* values, int8_t* zone)
+{
+    // +CCLK: "yy/MM/dd,hh:mm:ss+zz"
+    AtScanner scan(text);
+    if (!scan.skipTo('"')) return false;
+
+    static const char separators[] PROGMEM = "//,::";
+    for (uint8_t i = 0; i < 6; i++)
+    {
+        if (!scan.readDigits(2, values[i])) return false;
+        if (i < 5 && !scan.skip(pgm_read_byte(separators + i))) return false;
+    }
+
+    int32_t quarters;
+    if (!scan.readInt(quarters)) return false;
+    if (zone != NULL) *zone = quarters;
+    return true;
+}
+
+void Sim800L::_printStatusQuery(uint8_t query)
+{
+    switch (query)
+    {
+    case STATUS_CSQ:
+        this->NeoSWSerial::print(F("+CSQ"));
+        break;
+    case STATUS_CREG:
+        this->NeoSWSerial::print(F("+CREG?"));
+        break;
+    case STATUS_CPAS:
+        this->NeoSWSerial::print(F("+CPAS"));
+        break;
+    case STATUS_CCLK:
+        this->NeoSWSerial::print(F("+CCLK?"));
+        break;
+    case STATUS_CBC:
+        this->NeoSWSerial::print(F("+CBC"));
+        break;
+    }
+}
+
+// Valid from 2000 to 2099, the years of the RTC
+uint32_t Sim800L::_toEpoch(int year, int month, int day, int hour, int minute, int second)
+{
+    static const uint16_t daysBeforeMonth[12] PROGMEM = {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+
+    if (month < 1 || month > 12) return 0;
+
+    uint16_t years = year - 2000;
+    uint32_t days = years * 365UL + (years + 3) / 4;       // 2000 is leap
+    days += pgm_read_word(&daysBeforeMonth[month - 1]) + day - 1;
+    if (month > 2 && years % 4 == 0) days++;
+
+    return EPOCH_2000 + days * 86400UL + hour * 3600UL + minute * 60UL + second;
+}
+
+// values: yyyy, MM, dd, hh, mm, ss
+void Sim800L::_fromEpoch(uint32_t epoch, int* values)
+{
+    static const uint8_t daysInMonth[12] PROGMEM = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+    if (epoch < EPOCH_2000) epoch = EPOCH_2000;
+    epoch -= EPOCH_2000;
+
+    values[5] = epoch % 60;
+    values[4] = (epoch / 60) % 60;
+    values[3] = (epoch / 3600) % 24;
+
+    uint16_t days = epoch / 86400UL;
+    uint16_t year = 2000;
+    while (days >= (year % 4 == 0 ? 366 : 365))
+    {
+        days -= year % 4 == 0 ? 366 : 365;
+        year++;
+    }
+
+    uint8_t month = 0;
+    while (true)
+    {
+        uint8_t length = pgm_read_byte(&daysInMonth[month]);
+        if (month == 1 && year % 4 == 0) length++;
+        if (days < length) break;
+        days -= length;
+        month++;
+    }
+
+    values[0] = year;
+    values[1] = month + 1;
+    values[2] = days + 1;
+}
+
+void Sim800L::_setSmsSlot(uint8_t index, bool used, bool unread)
+{
+    if (index == 0 || index > SMS_SLOTS) return;
+    index--;
+    uint8_t mask = 1 << (index % 8);
+
+    if (used) _smsUsed[index / 8] |= mask;
+    else      _smsUsed[index / 8] &= ~mask;
+
+    if (used && unread) _smsNew[index / 8] |= mask;
+    else                _smsNew[index / 8] &= ~mask;
+}
+
+void Sim800L::_clearSmsSlots()
+{
+    memset(_smsUsed, 0, sizeof(_smsUsed));
+    memset(_smsNew, 0, sizeof(_smsNew));
+}
+
+bool Sim800L::_breakerAllows()
+{
+    if (_available) return true;
+    // half open: after the cooldown one command can probe the module again
+    return millis() - _breakerOpenedAt >= BREAKER_COOLDOWN;
+}
+
+void Sim800L::_markFailing(uint32_t since)
+{
+    if (_failing) return;
+    _failing = true;
+    _failingSince = since;
+}
+
+void Sim800L::_commandSucceeded()
+{
+    if (_failing) _recoveryTime = millis() - _failingSince;
+    _failing = false;
+    _failures = 0;
+    _available = true;
+}
+
+// Only a command without an answer counts for the breaker, an ERROR comes from a module that works
+void Sim800L::_commandFailed(uint32_t wasted, uint8_t result)
+{
+    _wastedSerialTime += wasted;
+    _markFailing(millis() - wasted);
+    if (result != RESULT_TIMEOUT && result != RESULT_CORRUPT)
+    {
+        _failures = 0;
+        _available = true;
+        return;
+    }
+    if (_failures < 255) _failures++;
+    if (_failures >= BREAKER_THRESHOLD)
+    {
+        _available = false;
+        _breakerOpenedAt = millis();
+    }
+}
+
+// Error if the command ends with ERROR, +CME ERROR or +CMS ERROR. A timeout is not an error
+bool Sim800L::_commandError(uint32_t timeout)
+{
+    _readSerialUntil(_response, sizeof(_response), timeout);
+    return _result == RESULT_ERROR || _result == RESULT_CORRUPT;
+}
+
+// Length of the whole response, or -1 if it doesn't end with OK
+int Sim800L::_readResponse(char* buffer, size_t size, uint32_t timeout)
+{
+    int length = _readSerialUntil(buffer, size, timeout);
+    return _result == RESULT_OK ? length : -1;
+}
+
+// Copy the field number index of "+XXX: a,"b,c",d" without quotes, return its length
+int Sim800L::_copyField(const char* text, uint8_t index, char* buffer, size_t size)
+{
+    if (size > 0) buffer[0] = '\0';
+
+    AtScanner scan(text);
+    if (!scan.skipTo(':') || !scan.next(index)) return -1;
+    return scan.readField(buffer, size);
+}
+
+// Like strlcpy, return the length of text
+int Sim800L::_copyString(const char* text, char* buffer, size_t size)
+{
+    size_t length = strlen(text);
+    if (size > 0)
+    {
+        size_t stored = length < size ? length : size - 1;
+        memcpy(buffer, text, stored);
+        buffer[stored] = '\0';
+    }
+    return length;
+}
+
+void Sim800L::_printTwoDigits(int value)
+{
+    if (value < 10) this->NeoSWSerial::print('0');
+    this->NeoSWSerial::print(value);
+}
+
+/*
+ * available() of the serial that watches the receive buffer: found full,
+ * the chars that arrived meanwhile were dropped and the answer being read
+ * is corrupt. It asserts RTS, the library is reading
+ */
+int Sim800L::_rxAvailable()
+{
+    if (_rtsPin != FLOW_NO_PIN && !_rxFlowing)
+    {
+        digitalWrite(_rtsPin, LOW);
+        _rxFlowing = true;
+    }
+
+    int count = this->NeoSWSerial::available();
+    uint32_t now = micros();
+
+    if (count >= SERIAL_RX_BUFFER - 1)
+    {
+        if (!_rxFull) _rxOverflows++;
+        _rxFull = true;
+        _rxCorrupt = true;
+
+        // the chars the line could carry since the last look, less the room there was
+        uint32_t elapsed = now - _rxCheckedAt;
+        if (elapsed > 1000000UL) elapsed = 1000000UL;
+        uint32_t arrived = elapsed / 1000 * _baud / 10000;
+        uint8_t room = SERIAL_RX_BUFFER - 1 - _rxLastCount;
+        if (arrived > room) _rxLost += arrived - room;
+    }
+    else _rxFull = false;
+
+    if (count > 0) _rxLastChar = millis();
+    _rxCheckedAt = now;
+    _rxLastCount = count;
+    return count;
+}
+
+// Drop RTS, the module holds what it has to send until the next read
+void Sim800L::_rxPause()
+{
+    if (_rtsPin == FLOW_NO_PIN || !_rxFlowing) return;
+    digitalWrite(_rtsPin, HIGH);
+    _rxFlowing = false;
+}
+
+// true when a corrupt answer went silent, its end won't come
+bool Sim800L::_rxStalled()
+{
+    return _rxCorrupt && millis() - _rxLastChar >= RX_IDLE_TIME;
+}
+
+// Feed the line reader with a received char. Return true when a final
+// result code (OK, ERROR, +CME ERROR, +CMS ERROR) is completed, the
+// other lines are handled as URCs
+bool Sim800L::_lineChar(char c)
+{
+    if (c == '\r') return false;
+    if (c != '\n')
+    {
+        if (_urcLength < URC_LINE_SIZE - 1) _urcLine[_urcLength++] = c;
+
+        if (_bodyLine)
         {
-            if (this->NeoSWSerial::available()>0)
-            {
-                str += (char) this->NeoSWSerial::read();
-            }
-        }       
+            // the text of a delivered +CMT goes out in chunks
+            if (!_smsDeliver || (_urcLength < SMS_CHUNK_SIZE && _urcLength < URC_LINE_SIZE - 1)) return false;
+            _smsChunkCallback(_urcLine, _urcLength);
+            _urcLength = 0;
+        }
+        // the sender of a +CMT, field 0, is matched while it arrives
+        else if (_urcLength == 5 && strncmp_P(_urcLine, PSTR("+CMT:"), 5) == 0)
+        {
+            _allowStart();
+            _cmtSender = 1;
+        }
+        else if (_cmtSender != 0 && c == '"') _cmtSender = _cmtSender == 1 ? 2 : 0;
+        else if (_cmtSender == 2) _allowChar(c);
+        return false;
     }
 
-    return str;
+    // the text of a message is payload, even "RING" or "OK", and it can be empty
+    bool text = _bodyLine;
+    _bodyLine = false;
+    _cmtSender = 0;
+    if (text && _smsDeliver)
+    {
+        _smsDeliver = false;
+        if (_urcLength > 0) _smsChunkCallback(_urcLine, _urcLength);
+        _smsChunkCallback(_urcLine, 0);
+        _urcLength = 0;
+        return false;
+    }
+    if (_urcLength == 0) return false;
+
+    _urcLine[_urcLength] = '\0';
+    _urcLength = 0;
+
+    if (!text && strcmp_P(_urcLine, PSTR("OK")) == 0)
+    {
+        _result = RESULT_OK;
+    }
+    else if (!text && (strcmp_P(_urcLine, PSTR("ERROR")) == 0 ||
+                       strncmp_P(_urcLine, PSTR("+CME ERROR"), 10) == 0 ||
+                       strncmp_P(_urcLine, PSTR("+CMS ERROR"), 10) == 0))
+    {
+        _result = RESULT_ERROR;
+    }
+    else
+    {
+        if (_asyncTag == ASYNC_TASK || _asyncTag == ASYNC_PROMPT) _appendAnswer(_urcLine);
+        if (text) return false;
+
+        _handleUrc(_urcLine);
+        if (strncmp_P(_urcLine, PSTR("+CMT:"), 5) == 0)
+        {
+            _bodyLine = true;
+            _smsDeliver = _cmtDeliver();
+        }
+        else _bodyLine = strncmp_P(_urcLine, PSTR("+CMGR:"), 6) == 0 ||
+                         strncmp_P(_urcLine, PSTR("+CMGL:"), 6) == 0;
+        return false;
+    }
+    return true;
+}
 
+// A +CMT header is complete: true if its text goes to the sketch
+bool Sim800L::_cmtDeliver()
+{
+    if (_smsChunkCallback == NULL || !_allowMatched()) return false;
+    if (_smsHeaderCallback == NULL) return true;
+
+    SmsHeader header;
+    strcpy_P(header.status, PSTR("REC UNREAD"));
+    _copyField(_urcLine, 0, header.number, sizeof(header.number));
+    _copyField(_urcLine, 2, header.timestamp, sizeof(header.timestamp));
+    return _smsHeaderCallback(header);
 }
 
-void Sim800L::_readSerialUntilReference(String& buffer, int max=1000, uint32_t timeout = TIME_OUT_READ_SERIAL)
+// Read until a final result code, buffer keeps the first size-1 chars.
+// Return the length of the whole response like snprintf, truncated if >= size
+int Sim800L::_readSerialUntil(char* buffer, size_t size, uint32_t timeout)
 {
 
-    uint64_t timeOld = millis();
-	
-	while (!buffer.endsWith("OK\r\n") && !buffer.endsWith("ERROR\r\n") && !(millis() > timeOld + timeout) && buffer.length() < max)
+    uint32_t timeOld = millis();
+    size_t length = 0;
+    _result = RESULT_TIMEOUT;
+    _rxCorrupt = false;
+
+    while (millis() - timeOld < timeout)
     {
-        while(this->NeoSWSerial::available() && buffer.length() < max)
+        if (!_rxAvailable())
         {
-            if (this->NeoSWSerial::available()>0)
-            {
-                buffer += (char) this->NeoSWSerial::read();
-            }
-        }       
+            // the final result code can be lost too, don't wait the timeout
+            if (_rxStalled()) break;
+            continue;
+        }
+
+        char c = (char) this->NeoSWSerial::read();
+        if (length + 1 < size) buffer[length] = c;
+        length++;
+        if (_lineChar(c)) break;
+    }
+    if (_rxCorrupt) _result = RESULT_CORRUPT;
+
+    if (size > 0) buffer[length < size ? length : size - 1] = '\0';
+    _rxPause();
+    return length;
+
+}
+
+// Wait the first char and read what is available, for prompts like "> "
+int Sim800L::_readSerial(char* buffer, size_t size, uint32_t timeout)
+{
+
+    uint32_t timeOld = millis();
+
+    while (!_rxAvailable() && millis() - timeOld < timeout)
+    {
+        delay(13);
+    }
+
+    size_t length = 0;
+    _result = RESULT_TIMEOUT;
+
+    while(_rxAvailable())
+    {
+        char c = (char) this->NeoSWSerial::read();
+        if (length + 1 < size) buffer[length] = c;
+        length++;
+        _lineChar(c);
+    }
+
+    if (size > 0) buffer[length < size ? length : size - 1] = '\0';
+    _rxPause();
+    return length;
+
+}
+
+#ifndef SIM800L_NO_STRING
+String Sim800L::_readSerialUntil(uint32_t timeout)
+{
+
+    uint32_t timeOld = millis();
+    String str;
+    _result = RESULT_TIMEOUT;
+    _rxCorrupt = false;
+
+    while (millis() - timeOld < timeout)
+    {
+        if (!_rxAvailable())
+        {
+            if (_rxStalled()) break;
+            continue;
+        }
+
+        char c = (char) this->NeoSWSerial::read();
+        str += c;
+        if (_lineChar(c)) break;
     }
-	
-    String str = buffer.substring(buffer.length() - 6);
-    while (!str.endsWith("OK\r\n") && !str.endsWith("ERROR\r\n") && !(millis() > timeOld + timeout))
+    if (_rxCorrupt) _result = RESULT_CORRUPT;
+
+    _rxPause();
+    return str;
+
+}
+
+// Keep the first max chars in buffer, the rest is read without storing it
+void Sim800L::_readSerialUntilReference(String& buffer, int max, uint32_t timeout)
+{
+
+    uint32_t timeOld = millis();
+    _result = RESULT_TIMEOUT;
+    _rxCorrupt = false;
+
+    while (millis() - timeOld < timeout)
     {
-        while(this->NeoSWSerial::available())
+        if (!_rxAvailable())
         {
-            if (this->NeoSWSerial::available()>0)
-            {
-                str += (char) this->NeoSWSerial::read();
-            }
-			if (str.length() > 50) {
-				str = str.substring(str.length() - 6);
-			}
-        }       
+            if (_rxStalled()) break;
+            continue;
+        }
+
+        char c = (char) this->NeoSWSerial::read();
+        if ((int) buffer.length() < max) buffer += c;
+        if (_lineChar(c)) break;
     }
+    if (_rxCorrupt) _result = RESULT_CORRUPT;
 
+    _rxPause();
 }
 
 // After read a char reset the millis. It is for read line in the first try
@@ -825,9 +3087,9 @@ String Sim800L::_readSerialUntilTime(uint32_t timeout)
 
     while (!(millis() > timeOld + timeout))
     {
-        while(this->NeoSWSerial::available())
+        while(_rxAvailable())
         {
-            if (this->NeoSWSerial::available()>0)
+            if (_rxAvailable()>0)
             {
                 str += (char) this->NeoSWSerial::read();
             }
@@ -835,31 +3097,205 @@ String Sim800L::_readSerialUntilTime(uint32_t timeout)
         }		
     }
 
+    _rxPause();
     return str;
 
 }
 
-String Sim800L::_readSerial(uint32_t timeout = TIME_OUT_READ_SERIAL)
+String Sim800L::_readSerial(uint32_t timeout)
 {
 
     uint64_t timeOld = millis();
 
-    while (!this->NeoSWSerial::available() && !(millis() > timeOld + timeout))
+    while (!_rxAvailable() && !(millis() > timeOld + timeout))
     {
         delay(13);
     }
 
     String str;
 
-    while(this->NeoSWSerial::available())
+    while(_rxAvailable())
     {
-        if (this->NeoSWSerial::available()>0)
+        if (_rxAvailable()>0)
         {
-            str += (char) this->NeoSWSerial::read();
+            char c = (char) this->NeoSWSerial::read();
+            str += c;
+            _lineChar(c);
         }
     }
 
+    _rxPause();
     return str;
 
 }
+#endif
+
+
+//
+//AT SCANNER
+//
+
+AtScanner::AtScanner(const char* text)
+{
+    _pos = text != NULL ? text : "";
+}
+
+static bool endOfLine(char c)
+{
+    return c == '\0' || c == '\r' || c == '\n';
+}
+
+static bool _isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+bool AtScanner::find(const char* prefix)
+{
+    const char* found = strstr_P(_pos, prefix);
+    if (found == NULL) return false;
+
+    _pos = found + strlen_P(prefix);
+    while (*_pos == ' ') _pos++;
+    return true;
+}
+
+bool AtScanner::skipTo(char c)
+{
+    const char* p = _pos;
+    while (*p != c)
+    {
+        if (endOfLine(*p)) return false;
+        p++;
+    }
+
+    _pos = p + 1;
+    while (*_pos == ' ') _pos++;
+    return true;
+}
+
+bool AtScanner::skip(char c)
+{
+    if (*_pos != c || endOfLine(c)) return false;
+    _pos++;
+    return true;
+}
+
+bool AtScanner::next(uint8_t count)
+{
+    const char* p = _pos;
+    bool quoted = false;
+    for (; count > 0; p++)
+    {
+        if (endOfLine(*p)) return false;
+        if (*p == '"') quoted = !quoted;
+        else if (*p == ',' && !quoted) count--;
+    }
+
+    _pos = p;
+    return true;
+}
+
+bool AtScanner::atEnd()
+{
+    return endOfLine(*_pos);
+}
+
+const char* AtScanner::position()
+{
+    return _pos;
+}
+
+bool AtScanner::readDigits(uint8_t width, int& value)
+{
+    int result = 0;
+    for (uint8_t i = 0; i < width; i++)
+    {
+        if (!_isDigit(_pos[i])) return false;
+        result = result * 10 + (_pos[i] - '0');
+    }
+
+    _pos += width;
+    value = result;
+    return true;
+}
+
+bool AtScanner::readInt(int32_t& value)
+{
+    return readFixed(value, 0);
+}
+
+bool AtScanner::readHex(uint32_t& value)
+{
+    const char* p = _pos;
+    uint32_t result = 0;
+    for (;; p++)
+    {
+        uint8_t digit;
+        if (_isDigit(*p)) digit = *p - '0';
+        else if (*p >= 'a' && *p <= 'f') digit = *p - 'a' + 10;
+        else if (*p >= 'A' && *p <= 'F') digit = *p - 'A' + 10;
+        else break;
+
+        if (result > 0x0FFFFFFFUL) return false;
+        result = (result << 4) | digit;
+    }
+    if (p == _pos) return false;
+
+    _pos = p;
+    value = result;
+    return true;
+}
+
+// "-73.123456" with 6 decimals is -73123456, the decimals after them are dropped
+bool AtScanner::readFixed(int32_t& value, uint8_t decimals)
+{
+    const char* p = _pos;
+    bool negative = (*p == '-');
+    if (negative || *p == '+') p++;
+    if (!_isDigit(*p)) return false;
+
+    uint32_t result = 0;
+    for (; _isDigit(*p); p++)
+    {
+        if (result > 214748364UL) return false;
+        result = result * 10 + (*p - '0');
+    }
+
+    bool fraction = (decimals > 0 && *p == '.' && _isDigit(p[1]));
+    if (fraction) p++;
+    for (; decimals > 0; decimals--)
+    {
+        if (result > 214748364UL) return false;
+        result *= 10;
+        if (fraction && _isDigit(*p)) result += *p++ - '0';
+    }
+    if (fraction) while (_isDigit(*p)) p++;
+    if (result > 0x7FFFFFFFUL) return false;
+
+    _pos = p;
+    value = negative ? -(int32_t) result : (int32_t) result;
+    return true;
+}
+
+// Like _copyString, return the length of the whole field, -1 at the end of the line
+int AtScanner::readField(char* buffer, size_t size)
+{
+    if (size > 0) buffer[0] = '\0';
+    if (atEnd()) return -1;
 
+    size_t length = 0;
+    bool quoted = false;
+    for (; !endOfLine(*_pos); _pos++)
+    {
+        if (*_pos == '"') quoted = !quoted;
+        else if (*_pos == ',' && !quoted) break;
+        else
+        {
+            if (length + 1 < size) buffer[length] = *_pos;
+            length++;
+        }
+    }
+    if (size > 0) buffer[length < size ? length : size - 1] = '\0';
+    return length;
+}
@@ -70,10 +70,281 @@
 #define DEFAULT_LED_FLAG    true    // true: use led.    false: don't user led.
 #define DEFAULT_LED_PIN     13      // pin to indicate states.
 
+// Uncomment (or build with -DSIM800L_NO_STRING) to remove every String API,
+// the char buffer APIs don't use the heap
+// #define SIM800L_NO_STRING
+
 #define BUFFER_RESERVE_MEMORY   255
+#define RESPONSE_BUFFER_SIZE    96      // internal buffer for the answers parsed by the library
+#define SMS_CHUNK_SIZE          32      // body chunk size of readSmsStream()
+#define SMS_SLOTS               50      // storage slots tracked by the sms slot index
 #define DEFAULT_BAUD_RATE       9600
 #define TIME_OUT_READ_SERIAL    5000
 
+// Retry policy defaults, see setRetryPolicy()
+#define RETRY_DEFAULT_ATTEMPTS      3
+#define RETRY_DEFAULT_BACKOFF       100     // ms before the second attempt, doubled after each failure
+#define RETRY_DEFAULT_MAX_BACKOFF   2000
+#define RETRY_DEFAULT_DEADLINE      15000   // ms for all the attempts of one command
+
+// Circuit breaker: after BREAKER_THRESHOLD consecutive commands without an answer
+// (timeout or corrupt) the module is marked unavailable and commands fail fast during BREAKER_COOLDOWN ms
+#define BREAKER_THRESHOLD   3
+#define BREAKER_COOLDOWN    30000
+
+// Command classes, each one has its own retry policy
+#define CMD_CLASS_BOOT      0       // AT handshake and SMS Ready wait of reset()
+#define CMD_CLASS_QUERY     1       // short queries, AT+CCLK?, AT+CPAS...
+#define CMD_CLASS_SMS       2       // sms related commands
+#define CMD_CLASS_COUNT     3
+
+#define RESET_PULSE         150     // ms, the module needs at least 105 ms
+
+// Receive buffer of NeoSWSerial (RX_BUFFER_SIZE), it keeps size-1 chars.
+// When it's full the chars that arrive are dropped. NeoSWSerial has no
+// overflow flag: a full buffer is a suspected overflow, see getRxOverflows()
+#define SERIAL_RX_BUFFER    64
+#define RX_IDLE_TIME        100     // ms of silence that end a corrupt answer
+#define FLOW_NO_PIN         255     // setFlowControl() without RTS or CTS
+#define FLOW_CTS_TIMEOUT    1000    // ms a char waits the CTS of the module
+#define FLOW_SLICE          20      // ms update() reads an answer with flow control
+#define FLOW_GAP            5       // ms of silence that end the slice before
+#define URC_LINE_SIZE       64      // longer unsolicited lines are truncated
+
+// Commands sent by update() without blocking
+#define ASYNC_NONE          0
+#define ASYNC_LINK          1       // link monitor, AT+CSQ, AT+CREG?, AT+CGREG?
+#define ASYNC_LOCATION      2       // AT+CIPGSMLOC=1,1
+#define ASYNC_CELL          3       // AT+CENG?, serving cell of the location
+#define ASYNC_TASK          4       // a command of a ModemTask
+#define ASYNC_PROMPT        5       // a command of a ModemTask answered by "> "
+#define ASYNC_HANG_UP       6       // ATH of a call not allowed
+#define ASYNC_TIMEOUT       3000
+
+// Voice call states, <stat> of +CLCC
+#define CALL_ACTIVE         0
+#define CALL_HELD           1
+#define CALL_DIALING        2
+#define CALL_ALERTING       3
+#define CALL_INCOMING       4
+#define CALL_WAITING        5
+#define CALL_DISCONNECTED   6
+#define CALL_IDLE           7       // previous state of a new call
+
+#define CALL_END_NONE       0
+#define CALL_END_NORMAL     1       // NO CARRIER or +CLCC disconnected
+#define CALL_END_BUSY       2
+#define CALL_END_NO_ANSWER  3
+
+#define CALL_SLOTS          2       // an active call and a waiting or held one
+#define CALL_EVENTS         4       // transitions queued until update()
+#define CALL_NUMBER_SIZE    20
+#define DTMF_QUEUE          8
+
+// Allow-list of the senders, setAllowList()
+#define ALLOW_LIST_MAX      32      // patterns, one bit each while matching
+#define ALLOW_DELETE_SMS    0x01    // delete the sms of the senders not allowed
+#define ALLOW_HANG_UP       0x02    // hang up the calls of the numbers not allowed
+#define SMS_REJECTED        -2      // readSmsStream(): the sender isn't allowed
+
+#define OPERATOR_SCAN_TIMEOUT   45000
+#define OPERATOR_SELECT_TIMEOUT 60000
+#define OPERATOR_NAME_SIZE      17
+#define OPERATOR_SHORT_SIZE     9
+#define OPERATOR_MAGIC          0xC5    // first byte of the operators saved in the EEPROM
+
+#define LOCATION_TIMEOUT        20000   // AT+CIPGSMLOC asks the server through the bearer
+#define LOCATION_CELL_INTERVAL  30000   // ms between two AT+CENG? while a fix is cached
+
+// Link monitor, see setLinkMonitor()
+#define LINK_SAMPLES        4       // samples of the rssi moving average
+#define RSSI_UNKNOWN        -128
+
+#define EPOCH_2000          946684800UL     // 2000/01/01 00:00:00 in unix time
+
+// Queries of readStatus(), can be combined with |
+#define STATUS_CSQ          0x01    // signal quality
+#define STATUS_CREG         0x02    // network registration
+#define STATUS_CPAS         0x04    // activity status
+#define STATUS_CCLK         0x08    // clock
+#define STATUS_CBC          0x10    // battery
+#define STATUS_ALL          0x1F
+
+// Final result of the last command, see getLastResult()
+#define RESULT_TIMEOUT      0
+#define RESULT_OK           1
+#define RESULT_ERROR        2       // ERROR, +CME ERROR or +CMS ERROR
+#define RESULT_PENDING      3       // a task command still waiting its answer
+#define RESULT_CORRUPT      4       // the receive buffer was full, chars of the answer may be lost
+
+// Status of a ModemTask, see runTask()
+#define TASK_RUNNING        0
+#define TASK_DONE           1
+#define TASK_FAILED         2
+
+// Subsystems, see isReady()
+#define READY_SIM           0x01    // +CPIN: READY
+#define READY_NETWORK       0x02    // Call Ready or registered, +CREG: 1/5
+#define READY_SMS           0x04    // SMS Ready
+#define READY_GPRS          0x08    // attached, +CGREG: 1/5
+
+// Boot milestones, see getBootTime()
+#define BOOT_RDY            0
+#define BOOT_CFUN           1
+#define BOOT_CPIN           2
+#define BOOT_CALL_READY     3
+#define BOOT_SMS_READY      4
+#define BOOT_MILESTONES     5
+
+
+struct SmsHeader
+{
+    char status[12];        // REC UNREAD, REC READ, STO UNSENT, STO SENT
+    char number[24];
+    char timestamp[24];     // yy/MM/dd,hh:mm:ss+zz
+};
+
+// Longitude and latitude in millionths of degree, as AT+CIPGSMLOC gives them
+struct GsmLocation
+{
+    int32_t  longitude;
+    int32_t  latitude;
+    uint16_t code;              // location code of the last request, 0 success
+    uint16_t cellId;            // serving cell of the fix, 0 unknown
+    uint32_t time;              // millis() of the fix, 0 no fix
+};
+
+// An operator of AT+COPS=?
+struct OperatorInfo
+{
+    uint8_t  status;            // 0 unknown, 1 available, 2 current, 3 forbidden
+    uint8_t  accessTechnology;  // 0 GSM
+    uint32_t plmn;              // numeric MCC and MNC, 22210
+    char     longName[OPERATOR_NAME_SIZE];
+    char     shortName[OPERATOR_SHORT_SIZE];
+};
+
+struct CallInfo
+{
+    uint8_t  id;                // <id> of +CLCC, 0 free slot
+    uint8_t  state;             // CALL_*
+    bool     incoming;
+    bool     allowed;           // the number is in the allow-list, or there isn't a list
+    uint8_t  endReason;         // CALL_END_*
+    char     number[CALL_NUMBER_SIZE];
+    uint32_t start;             // millis() of the first event
+    uint32_t connected;         // millis() when it became active, 0 never
+    uint32_t duration;          // ms active
+};
+
+struct StatusSnapshot
+{
+    uint8_t  valid;             // STATUS_* of the fields read
+    int8_t   rssi;              // dBm, RSSI_UNKNOWN if not detectable
+    uint8_t  ber;
+    uint8_t  registration;      // +CREG stat
+    uint8_t  activity;          // +CPAS, 0 ready, 3 ringing, 4 call in progress
+    uint32_t epoch;             // RTC in unix time
+    uint8_t  batteryLevel;      // %
+    uint16_t batteryVoltage;    // mV
+    uint8_t  roundTrips;        // commands sent to read it
+    uint32_t elapsed;           // ms
+};
+
+// good: the average rssi is >= the threshold and the module is registered
+typedef void (*LinkCallback)(bool good, int8_t rssi);
+
+// call.state is the new state, called by update() for every transition
+typedef void (*CallCallback)(const CallInfo& call, uint8_t previous);
+typedef void (*DtmfCallback)(char key);
+
+// Return false to skip the body of the message
+typedef bool (*SmsHeaderCallback)(const SmsHeader& header);
+// For onSms() a chunk of length 0 ends the body
+typedef void (*SmsChunkCallback)(const char* chunk, uint8_t length);
+
+
+struct RetryPolicy
+{
+    uint8_t  attempts;      // max attempts, 1 means no retry
+    uint16_t backoff;       // ms to wait before the second attempt
+    uint16_t maxBackoff;    // limit for the exponential backoff
+    uint32_t deadline;      // overall ms budget for all the attempts
+};
+
+class Sim800L;
+struct ModemTask;
+
+// A step of a task, returns TASK_RUNNING until the flow is over
+typedef int8_t (*TaskFunction)(Sim800L& gsm, ModemTask& task);
+
+/*
+ * A resumable flow in the style of protothreads: runTask() calls the
+ * function again and the TASK_* macros jump back where it waited.
+ * The state lives here, no heap; locals don't survive a wait.
+ */
+struct ModemTask
+{
+    TaskFunction function;
+    uint16_t line;              // where the function resumes, 0 the start
+    uint8_t  stage;             // free for the flow, startUpdateRtc() runs the bearer in stage 0
+    uint8_t  status;            // TASK_*
+    uint8_t  result;            // RESULT_* of the last command, RESULT_PENDING while waiting
+    bool     sent;              // taskCommand() sent the command
+    const char* text[2];        // arguments of the flow
+    int32_t  value[2];
+    void*    data;              // given to startTask()
+    uint32_t since;             // millis() of TASK_DELAY
+    uint16_t steps;
+    uint32_t lastCost;          // us spent by the last step
+    uint32_t maxCost;
+    uint32_t totalCost;
+};
+
+// The resume points are case labels reached on purpose by the code before them
+#if defined(__GNUC__) && __GNUC__ >= 7
+#define TASK_FALLTHROUGH                    __attribute__((fallthrough))
+#else
+#define TASK_FALLTHROUGH
+#endif
+
+// Flow control of a TaskFunction, from TASK_BEGIN to TASK_END. One wait per line
+#define TASK_BEGIN(task)                    switch ((task).line) { case 0:
+#define TASK_END(task)                      } (task).line = 0; return TASK_DONE
+#define TASK_FAIL(task)                     do { (task).line = 0; return TASK_FAILED; } while (0)
+#define TASK_YIELD(task)                    do { (task).line = __LINE__; return TASK_RUNNING; case __LINE__:; } while (0)
+#define TASK_WAIT_UNTIL(task, condition)    do { (task).line = __LINE__; TASK_FALLTHROUGH; case __LINE__: \
+                                                 if (!(condition)) return TASK_RUNNING; } while (0)
+#define TASK_DELAY(task, ms)                do { (task).since = millis(); (task).line = __LINE__; TASK_FALLTHROUGH; case __LINE__: \
+                                                 if (millis() - (task).since < (uint32_t) (ms)) return TASK_RUNNING; } while (0)
+#define TASK_COMMAND(gsm, task, ...)        TASK_WAIT_UNTIL(task, (gsm).taskCommand(task, __VA_ARGS__))
+
+/*
+ * Read the fields of an answer in place, without copies or heap.
+ * The reads stop at the end of the line ('\0', '\r' or '\n') and return
+ * false when the text doesn't match, the position is unchanged then.
+ */
+class AtScanner
+{
+public:
+    AtScanner(const char* text);
+
+    bool find(const char* prefix);      // PSTR() prefix, move after it and the spaces
+    bool skipTo(char c);                // move after the next c of the line and the spaces
+    bool skip(char c);                  // move after c if it is the next char
+    bool next(uint8_t count = 1);       // move after count commas out of the quotes
+    bool atEnd();
+    const char* position();
+
+    bool readDigits(uint8_t width, int& value);             // exactly width digits
+    bool readInt(int32_t& value);                           // [+-]digits
+    bool readHex(uint32_t& value);
+    bool readFixed(int32_t& value, uint8_t decimals);       // [+-]digits[.digits] * 10^decimals
+    int  readField(char* buffer, size_t size);              // quoted or not, up to the comma
+
+private:
+    const char* _pos;
+};
 
 class Sim800L : public NeoSWSerial
 {
@@ -84,12 +355,166 @@ private:
     // String _buffer;
     bool _sleepMode;
     uint8_t _functionalityMode;
-    String _locationCode;
-    String _longitude;
-    String _latitude;
+    const char* _allowList;         // PROGMEM patterns, each ended by '\0'
+    uint8_t  _allowCount;
+    uint8_t  _allowActions;         // ALLOW_DELETE_SMS | ALLOW_HANG_UP
+    uint32_t _allowAlive;           // patterns still matching the number
+    uint32_t _allowPrefix;          // patterns matched up to their '*'
+    uint8_t  _allowPosition;
+    bool     _bodyLine;             // the next line is the text of a +CMGR, +CMGL or +CMT
+    uint8_t  _cmtSender;            // in a +CMT line: 1 before the number, 2 in it
+    bool     _smsDeliver;           // the text of the +CMT goes to _smsChunkCallback
+    SmsHeaderCallback _smsHeaderCallback;
+    SmsChunkCallback  _smsChunkCallback;
+    bool     _rejectCall;           // update() hangs up when the channel is free
 
-    
+    void _allowStart();
+    void _allowChar(char c);
+    bool _allowMatched();
+    bool _cmtDeliver();
 
+    OperatorInfo* _operators;       // the cache given to setOperatorCache()
+    uint8_t  _operatorSlots;
+    uint8_t  _operatorCount;
+    int      _operatorAddress;      // EEPROM address of the cache, -1 not saved
+
+    bool _parseOperator(const char* text, OperatorInfo& info);
+    void _saveOperators();
+    void _loadOperators();
+
+    GsmLocation _location;
+    uint32_t _locationTtl;          // 0 location service disabled
+    bool     _locationRefresh;      // a new fix is wanted, update() asks it
+    uint16_t _cellId;               // serving cell from AT+CENG?
+    uint32_t _cellCheckedAt;
+
+    char    _response[RESPONSE_BUFFER_SIZE];
+    uint8_t _result;                // RESULT_* of the last command
+
+    RetryPolicy _retryPolicy[CMD_CLASS_COUNT];
+    uint8_t  _failures;             // consecutive commands without an answer
+    bool     _available;            // false while the circuit breaker is open
+    uint32_t _breakerOpenedAt;
+    bool     _failing;
+    uint32_t _failingSince;         // millis() of the first failed attempt of the current streak
+    uint32_t _recoveryTime;
+    uint32_t _wastedSerialTime;
+
+    void _init();
+    void _initRetry();
+    bool _sendCommand(const __FlashStringHelper* command, const char* expected, uint8_t commandClass, uint32_t timeout = TIME_OUT_READ_SERIAL);
+    bool _breakerAllows();
+    void _markFailing(uint32_t since);
+    void _commandSucceeded();
+    void _commandFailed(uint32_t wasted, uint8_t result);
+
+    uint8_t  _ready;                // READY_* flags
+    uint32_t _bootStart;
+    uint32_t _bootTime[BOOT_MILESTONES];
+    char     _urcLine[URC_LINE_SIZE];
+    uint8_t  _urcLength;
+
+    uint8_t  _rtsPin;               // FLOW_NO_PIN without flow control
+    uint8_t  _ctsPin;
+    bool     _rxFlowing;            // RTS asserted, the module can send
+    bool     _rxFull;
+    bool     _rxCorrupt;            // an overflow is suspected in the current answer
+    uint8_t  _rxLastCount;
+    uint32_t _rxCheckedAt;          // micros() of the last look at the buffer
+    uint32_t _rxLastChar;           // millis() of the last char available
+    uint32_t _rxOverflows;          // suspected, the buffer was found full
+    uint32_t _rxLost;               // estimated
+
+    int  _rxAvailable();
+    void _rxPause();
+    bool _rxStalled();
+    bool _lineChar(char c);
+    void _handleUrc(const char* line);
+    void _bootMilestone(uint8_t milestone);
+
+    uint8_t _smsUsed[(SMS_SLOTS + 7) / 8];     // bit index-1: slot occupied
+    uint8_t _smsNew[(SMS_SLOTS + 7) / 8];      // bit index-1: unread sms
+    uint8_t _smsCapacity;
+
+    void _setSmsSlot(uint8_t index, bool used, bool unread);
+    void _clearSmsSlots();
+
+    uint8_t  _asyncTag;             // ASYNC_* of the command running, ASYNC_NONE if idle
+    uint32_t _asyncSince;
+    uint32_t _asyncTimeout;
+
+    uint32_t _linkInterval;         // 0 disabled
+    uint32_t _linkLastSample;
+    uint8_t  _linkStep;
+    int8_t   _rssi;
+    uint8_t  _ber;
+    uint8_t  _registration;
+    uint8_t  _gprsRegistration;
+    int8_t   _rssiSamples[LINK_SAMPLES];
+    uint8_t  _rssiCount;
+    uint8_t  _rssiIndex;
+    int8_t   _rssiAverage;
+    int8_t   _rssiTrend;
+    int8_t   _linkThreshold;
+    bool     _linkGood;
+    bool     _linkChanged;
+    LinkCallback _linkCallback;
+
+    bool _startAsync(const __FlashStringHelper* command, uint8_t tag, uint32_t timeout = ASYNC_TIMEOUT);
+    void _pollAsync();
+    void _waitAsync();
+    void _finishAsync();
+    void _monitorLink();
+    void _monitorLocation();
+    void _parseLocation(const char* data);
+    void _parseCell(const char* line);
+    int _formatFixed(int32_t value, char* buffer, size_t size);
+    void _addRssiSample(uint8_t csq);
+    void _checkLink();
+
+    CallInfo _calls[CALL_SLOTS];
+    uint8_t  _callEvents[CALL_EVENTS];  // slot << 6 | previous << 3 | state
+    uint8_t  _callEventCount;
+    uint8_t  _callEndReason;            // BUSY or NO ANSWER before the +CLCC of the end
+    bool     _callReports;              // AT+CLCC=1 accepted
+    CallCallback _callCallback;
+    char     _dtmf[DTMF_QUEUE];
+    uint8_t  _dtmfCount;
+    DtmfCallback _dtmfCallback;
+
+    CallInfo* _findCall(uint8_t id, bool create);
+    void _setCallState(CallInfo* call, uint8_t state);
+    void _endCalls(uint8_t reason);
+    void _dispatchCalls();
+
+    int8_t _timeZone;               // quarters of hour, from *PSUTTZ or +CTZV
+    bool   _networkTime;            // network time received in this boot
+
+    StatusSnapshot* _snapshot;      // filled by _handleUrc while readStatus() runs
+
+    ModemTask* _taskOwner;          // the task holding the command channel, NULL free
+    ModemTask* _taskWaiting;        // the task of the ASYNC_TASK command running
+    uint8_t    _taskNext;           // runTasks() starts from here
+
+    bool _runBlocking(ModemTask& task);
+    void _appendAnswer(const char* line);
+    static int8_t _sendSmsTask(Sim800L& gsm, ModemTask& task);
+    static int8_t _bearerTask(Sim800L& gsm, ModemTask& task);
+    static int8_t _updateRtcTask(Sim800L& gsm, ModemTask& task);
+
+    bool _readRtc(int* values, int8_t* zone);
+    bool _parseClock(const char* text, int* values, int8_t* zone);
+    void _printStatusQuery(uint8_t query);
+    void _printRtc(uint32_t epoch, int8_t timeZone);
+    uint32_t _parseNetDate(const char* text);
+    uint32_t _toEpoch(int year, int month, int day, int hour, int minute, int second);
+    void _fromEpoch(uint32_t epoch, int* values);
+
+    bool _commandError(uint32_t timeout = TIME_OUT_READ_SERIAL);
+    int  _readResponse(char* buffer, size_t size, uint32_t timeout = TIME_OUT_READ_SERIAL);
+    int  _copyField(const char* text, uint8_t index, char* buffer, size_t size);
+    int  _copyString(const char* text, char* buffer, size_t size);
+    void _printTwoDigits(int value);
 
 public:
     uint8_t RX_PIN;
@@ -105,53 +530,159 @@ public:
 
     void begin();                   //Default baud 9600
     void begin(uint32_t baud);
-    void reset();
+    bool reset();
+
+    void setRetryPolicy(uint8_t commandClass, RetryPolicy policy);
+    RetryPolicy getRetryPolicy(uint8_t commandClass);
+    bool isAvailable();
+    uint32_t getRecoveryTime();
+    uint32_t getWastedSerialTime();
+    void resetRetryMetrics();
+
+    void update();
+    size_t write(uint8_t c);
+    using NeoSWSerial::write;
+    bool isReady(uint8_t subsystems);
+    bool waitReady(uint8_t subsystems, uint32_t timeout);
+    uint32_t getBootTime(uint8_t milestone);
+    uint8_t getLastResult();
+    bool setFlowControl(uint8_t rtsPin, uint8_t ctsPin);
+    bool disableFlowControl();
+    uint32_t getRxOverflows();
+    uint32_t getRxLost();
+    void resetRxStats();
+
+    void startTask(ModemTask& task, TaskFunction function, void* data = NULL);
+    int8_t runTask(ModemTask& task);
+    uint8_t runTasks(ModemTask** tasks, uint8_t count, uint32_t budget);
+    bool taskAcquire(ModemTask& task);
+    void taskRelease(ModemTask& task);
+    void taskExpect(ModemTask& task, uint32_t timeout = TIME_OUT_READ_SERIAL, bool prompt = false);
+    bool taskCommand(ModemTask& task, const __FlashStringHelper* command, uint32_t timeout = TIME_OUT_READ_SERIAL);
+    bool taskCommand(ModemTask& task, const __FlashStringHelper* command, const char* text, const __FlashStringHelper* end,
+                     uint32_t timeout = TIME_OUT_READ_SERIAL, bool prompt = false);
+    const char* getTaskAnswer();
+    void startSendSms(ModemTask& task, const char* number, const char* text);
+    void startBearer(ModemTask& task, const char* apn = "internet");
+    void startUpdateRtc(ModemTask& task, int utc);
 
     bool setSleepMode(bool state);
     bool getSleepMode();
     bool setFunctionalityMode(uint8_t fun);
     uint8_t getFunctionalityMode();
-    bool Sim800L::setMessageStorage(String value);
-    bool Sim800L::setMessageFormat(String value);
-	bool Sim800L::setClip(String value);
+    bool setMessageStorage(const char* value);
+    bool setMessageFormat(const char* value);
+	bool setClip(const char* value);
 
-    bool setPIN(String pin);
-    String getProductInfo();
+    bool setPIN(const char* pin);
 
-    String getOperatorsList();
-    String getOperator();
+    /*
+     * The char buffer APIs write at most size-1 chars and always end the
+     * buffer with '\0'. They return the length of the whole answer, like
+     * snprintf: a value >= size means it was truncated. -1 is an error.
+     */
+    int getProductInfo(char* buffer, size_t size);
+
+    int getOperatorsList(char* buffer, size_t size);
+    int getOperator(char* buffer, size_t size);
+    void setOperatorCache(OperatorInfo* list, uint8_t size, int eepromAddress = -1);
+    int scanOperators();
+    uint8_t getOperatorCount();
+    uint32_t getPlmn();
+    bool selectOperator(uint32_t plmn);
 
     bool calculateLocation();
-    String getLocationCode();
-    String getLongitude();
-    String getLatitude();
+    int getLocationCode(char* buffer, size_t size);
+    int getLongitude(char* buffer, size_t size);
+    int getLatitude(char* buffer, size_t size);
+    bool setLocationService(uint32_t ttl);
+    bool getLocation(GsmLocation& location);
+    bool refreshLocation();
+    bool isLocationFresh();
+    uint32_t getLocationAge();
+    uint16_t getCellId();
 
     bool answerCall();
     bool callNumber(char* number);
     bool hangoffCall();
     uint8_t getCallStatus();
+    bool onCallChange(CallCallback callback);
+    bool onDtmf(DtmfCallback callback);
+    uint8_t getCallCount();
+    bool getCall(uint8_t index, CallInfo& call);
 
     bool sendSms(char* number,char* text);
-    String readSms(uint8_t index);
-	void readSmsReference(uint8_t index, String& buffer, int max=1000);
-    String getNumberSms(uint8_t index);
+    int readSms(uint8_t index, char* buffer, size_t size);
+    int getNumberSms(uint8_t index, char* buffer, size_t size);
+    bool setAllowList(const char* list, uint8_t actions = 0);
+    bool isAllowed(const char* number);
+    int readSmsStream(uint8_t index, SmsHeaderCallback onHeader, SmsChunkCallback onChunk, uint32_t timeout = TIME_OUT_READ_SERIAL);
+    bool onSms(SmsHeaderCallback onHeader, SmsChunkCallback onChunk);
 	bool delSms(uint8_t index, uint8_t option);
     bool delAllSms();
 
+    bool syncSmsSlots();
+    bool isSmsSlotUsed(uint8_t index);
+    bool isSmsNew(uint8_t index);
+    uint8_t nextNewSms(uint8_t from = 1);
+    uint8_t getSmsCount();
+    uint8_t getSmsCapacity();
 
-    String signalQuality();
+
+    int signalQuality(char* buffer, size_t size);
+    void setLinkMonitor(uint32_t interval);
+    void onLinkChange(int8_t threshold, LinkCallback callback);
+    int8_t getRssi();
+    int8_t getRssiAverage();
+    int8_t getRssiTrend();
+    uint8_t getBer();
+    uint8_t getRegistration();
+    uint8_t getGprsRegistration();
+    bool readStatus(StatusSnapshot& status, uint8_t queries = STATUS_ALL, bool pipeline = true);
     void setPhoneFunctionality();
     void activateBearerProfile();
     void deactivateBearerProfile();
 
-    void RTCtime(int *day,int *month, int *year,int *hour,int *minute, int *second);
-    String dateNet();
+    bool RTCtime(int *day,int *month, int *year,int *hour,int *minute, int *second);
+    int dateNet(char* buffer, size_t size);
     bool updateRtc(int utc);
-    
+
+    bool enableNetworkTime();
+    bool isNetworkTimeSynced();
+    int8_t getTimeZone();
+    uint32_t getEpoch();
+    bool setRtc(uint32_t epoch, int8_t timeZone);
+
+    int _readSerialUntil(char* buffer, size_t size, uint32_t timeout = TIME_OUT_READ_SERIAL);
+    int _readSerial(char* buffer, size_t size, uint32_t timeout = TIME_OUT_READ_SERIAL);
+
+#ifndef SIM800L_NO_STRING
+    bool setMessageStorage(String value);
+    bool setMessageFormat(String value);
+	bool setClip(String value);
+
+    bool setPIN(String pin);
+    String getProductInfo();
+
+    String getOperatorsList();
+    String getOperator();
+
+    String getLocationCode();
+    String getLongitude();
+    String getLatitude();
+
+    String readSms(uint8_t index);
+	void readSmsReference(uint8_t index, String& buffer, int max=1000);
+    String getNumberSms(uint8_t index);
+
+    String signalQuality();
+    String dateNet();
+
     String _readSerialUntil(uint32_t timeout = TIME_OUT_READ_SERIAL);
 	void _readSerialUntilReference(String& buffer, int max=1000, uint32_t timeout = TIME_OUT_READ_SERIAL);
 	String _readSerialUntilTime(uint32_t timeout);
     String _readSerial(uint32_t timeout = TIME_OUT_READ_SERIAL);
+#endif
 
 };
 
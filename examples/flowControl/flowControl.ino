@@ -0,0 +1,132 @@
+/* 
+ *  This library was written by Vittorio Esposito
+ *    https://github.com/VittorioEsposito
+ *
+ *  Designed to work with the GSM Sim800L.
+ *
+ *  ENG
+ *    This library uses SoftwareSerial, you can define RX and TX pins
+ *    in the header "Sim800L.h", by default pins are RX=10 and TX=11.
+ *    Be sure that GND is connected to arduino too. 
+ *    You can also change the RESET_PIN as you prefer.
+ *  
+ *  ESP
+ *    Esta libreria usa SoftwareSerial, se pueden cambiar los pines de RX y TX
+ *    en el archivo header, "Sim800L.h", por defecto los pines vienen configurado en
+ *    RX=10 TX=11.  
+ *    Tambien se puede cambiar el RESET_PIN por otro que prefiera
+ * 
+ *  ITA
+ *    Questa libreria utilizza la SoftwareSerial, si possono cambiare i pin di RX e TX
+ *    dall' intestazione "Sim800L.h", di default essi sono impostati come RX=10 RX=11
+ *    Assicurarsi di aver collegato il dispositivo al pin GND di Arduino.
+ *    E' anche possibile cambiare il RESET_PIN.
+ *
+ *
+ *   DEFAULT PINOUT: 
+ *        _____________________________
+ *       |  ARDUINO UNO >>>   Sim800L  |
+ *        -----------------------------
+ *            GND      >>>   GND
+ *        RX  10       >>>   TX    
+ *        TX  11       >>>   RX
+ *       RESET 2       >>>   RST 
+ *                 
+ *   POWER SOURCE 4.2V >>> VCC
+ *
+ *
+ *  SOFTWARE SERIAL NOTES:
+ *
+ *    PINOUT
+ *    The library has the following known limitations:
+ *    1. If using multiple software serial ports, only one can receive data at a time.
+ *    2. Not all pins on the Mega and Mega 2560 support change interrupts, so only the following can be used for RX: 10, 11, 12, 13, 14, 15, 50, 51, 52, 53, A8 (62), A9 (63), A10 (64), A11 (65), A12 (66), A13 (67), A14 (68), A15 (69).
+ *    3. Not all pins on the Leonardo and Micro support change interrupts, so only the following can be used for RX: 8, 9, 10, 11, 14 (MISO), 15 (SCK), 16 (MOSI).
+ *    4. On Arduino or Genuino 101 the current maximum RX speed is 57600bps
+ *    5. On Arduino or Genuino 101 RX doesn't work on Pin 13
+ *  
+ *    BAUD RATE
+ *    Supported baud rates are 300, 600, 1200, 2400, 4800, 9600, 14400, 19200, 28800, 31250, 38400, 57600, and 115200.
+ *
+ *
+ *  Edited on:  December 24, 2016
+ *    Editor:   Vittorio Esposito
+ *    
+ *  Original version by:   Cristian Steib
+ *        
+ *
+*/
+
+#include <Sim800L.h>
+#include <SoftwareSerial.h>               
+
+#define RX  10
+#define TX  11
+
+Sim800L GSM(RX, TX);
+
+/*
+ * In alternative:
+ * Sim800L GSM;                       // Use default pinout
+ * Sim800L GSM(RX, TX, RESET);        
+ * Sim800L GSM(RX, TX, RESET, LED);
+ */
+
+// Wire the RTS and CTS pads of the module to two free pins
+#define RTS_PIN  4      // arduino output >>> RTS of Sim800L
+#define CTS_PIN  5      // arduino input  <<< CTS of Sim800L
+
+ModemTask listTask;
+
+// The answer of AT+CMGL is some hundreds of chars, more than the 63 of the receive buffer
+int8_t listSms(Sim800L& gsm, ModemTask& task) {
+  TASK_BEGIN(task);
+  TASK_COMMAND(gsm, task, F("AT+CMGF=1\r\n"));
+  TASK_COMMAND(gsm, task, F("AT+CMGL=\"ALL\",1\r\n"), 20000);
+  TASK_END(task);
+}
+
+// List the stored sms while the sketch is busy for busy ms between two updates
+void measure(uint16_t busy) {
+  GSM.resetRxStats();
+  uint32_t start = millis();
+
+  GSM.startTask(listTask, listSms);
+  while (GSM.runTask(listTask) == TASK_RUNNING) {
+    delay(busy);        // the rest of the sketch
+  }
+
+  Serial.print(busy);
+  Serial.print(" ms busy: ");
+  Serial.print(listTask.result == RESULT_OK ? "ok" : listTask.result == RESULT_CORRUPT ? "corrupt" : "failed");
+  // NeoSWSerial doesn't report drops: the overflows are suspected (full buffer), the loss estimated
+  Serial.print(", suspected overflows ");
+  Serial.print(GSM.getRxOverflows());
+  Serial.print(", estimated lost chars ");
+  Serial.print(GSM.getRxLost());
+  Serial.print(", ");
+  Serial.print(millis() - start);
+  Serial.println(" ms");
+}
+
+void setup(){
+  Serial.begin(9600);
+  GSM.begin(38400);     // the highest rate of NeoSWSerial, 3.8 chars per ms
+  GSM.reset();
+
+  uint16_t busy[] = { 0, 10, 50, 200 };
+
+  Serial.println("Without flow control");
+  for (uint8_t i = 0; i < 4; i++) measure(busy[i]);
+
+  // AT+IFC=2,2: the module sends only while the library reads
+  if (!GSM.setFlowControl(RTS_PIN, CTS_PIN)) {
+    Serial.println("AT+IFC=2,2 failed");
+    return;
+  }
+  Serial.println("With RTS/CTS");
+  for (uint8_t i = 0; i < 4; i++) measure(busy[i]);
+}
+
+void loop(){
+}
@@ -0,0 +1,167 @@
+/* 
+ *  This library was written by Vittorio Esposito
+ *    https://github.com/VittorioEsposito
+ *
+ *  Designed to work with the GSM Sim800L.
+ *
+ *  ENG
+ *    This library uses SoftwareSerial, you can define RX and TX pins
+ *    in the header "Sim800L.h", by default pins are RX=10 and TX=11.
+ *    Be sure that GND is connected to arduino too. 
+ *    You can also change the RESET_PIN as you prefer.
+ *  
+ *  ESP
+ *    Esta libreria usa SoftwareSerial, se pueden cambiar los pines de RX y TX
+ *    en el archivo header, "Sim800L.h", por defecto los pines vienen configurado en
+ *    RX=10 TX=11.  
+ *    Tambien se puede cambiar el RESET_PIN por otro que prefiera
+ * 
+ *  ITA
+ *    Questa libreria utilizza la SoftwareSerial, si possono cambiare i pin di RX e TX
+ *    dall' intestazione "Sim800L.h", di default essi sono impostati come RX=10 RX=11
+ *    Assicurarsi di aver collegato il dispositivo al pin GND di Arduino.
+ *    E' anche possibile cambiare il RESET_PIN.
+ *
+ *
+ *   DEFAULT PINOUT: 
+ *        _____________________________
+ *       |  ARDUINO UNO >>>   Sim800L  |
+ *        -----------------------------
+ *            GND      >>>   GND
+ *        RX  10       >>>   TX    
+ *        TX  11       >>>   RX
+ *       RESET 2       >>>   RST 
+ *                 
+ *   POWER SOURCE 4.2V >>> VCC
+ *
+ *
+ *  SOFTWARE SERIAL NOTES:
+ *
+ *    PINOUT
+ *    The library has the following known limitations:
+ *    1. If using multiple software serial ports, only one can receive data at a time.
+ *    2. Not all pins on the Mega and Mega 2560 support change interrupts, so only the following can be used for RX: 10, 11, 12, 13, 14, 15, 50, 51, 52, 53, A8 (62), A9 (63), A10 (64), A11 (65), A12 (66), A13 (67), A14 (68), A15 (69).
+ *    3. Not all pins on the Leonardo and Micro support change interrupts, so only the following can be used for RX: 8, 9, 10, 11, 14 (MISO), 15 (SCK), 16 (MOSI).
+ *    4. On Arduino or Genuino 101 the current maximum RX speed is 57600bps
+ *    5. On Arduino or Genuino 101 RX doesn't work on Pin 13
+ *  
+ *    BAUD RATE
+ *    Supported baud rates are 300, 600, 1200, 2400, 4800, 9600, 14400, 19200, 28800, 31250, 38400, 57600, and 115200.
+ *
+ *
+ *  Edited on:  December 24, 2016
+ *    Editor:   Vittorio Esposito
+ *    
+ *  Original version by:   Cristian Steib
+ *        
+ *
+*/
+
+#include <Sim800L.h>
+#include <SoftwareSerial.h>               
+
+#define RX  10
+#define TX  11
+
+Sim800L GSM(RX, TX);
+
+/*
+ * In alternative:
+ * Sim800L GSM;                       // Use default pinout
+ * Sim800L GSM(RX, TX, RESET);        
+ * Sim800L GSM(RX, TX, RESET, LED);
+ */
+
+/*
+ * Cost of parsing a +CCLK answer, like RTCtime() does.
+ * before: the String substring().toInt() chain the library used
+ * after:  AtScanner, it reads the fields in place
+ * The cycles are the average of RUNS parses, the allocations are the
+ * malloc() and realloc() calls of the first parse. The freed Strings leave
+ * no trace in the heap break, so the calls are counted wrapping them: add
+ *   -Wl,--wrap=malloc -Wl,--wrap=realloc
+ * to the link flags (compiler.c.elf.extra_flags in platform.local.txt)
+ * and uncomment COUNT_ALLOCATIONS. Without it "-" is printed.
+ */
+
+//#define COUNT_ALLOCATIONS
+
+#define RUNS 1000
+
+const char answer[] = "\r\n+CCLK: \"24/03/01,12:34:56+04\"\r\n\r\nOK\r\n";
+int values[6];
+
+#ifdef COUNT_ALLOCATIONS
+uint16_t allocations = 0;
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size) {
+  allocations++;
+  return __real_malloc(size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+  allocations++;
+  return __real_realloc(ptr, size);
+}
+}
+#endif
+
+#ifndef SIM800L_NO_STRING
+void parseWithString() {
+  String buffer = answer;
+  buffer = buffer.substring(buffer.indexOf("\"") + 1, buffer.lastIndexOf("\"") - 1);
+  values[0] = buffer.substring(0, 2).toInt();
+  values[1] = buffer.substring(3, 5).toInt();
+  values[2] = buffer.substring(6, 8).toInt();
+  values[3] = buffer.substring(9, 11).toInt();
+  values[4] = buffer.substring(12, 14).toInt();
+  values[5] = buffer.substring(15, 17).toInt();
+}
+#endif
+
+void parseWithScanner() {
+  AtScanner scan(answer);
+  if (!scan.find(PSTR("+CCLK:")) || !scan.skip('"')) return;
+  scan.readDigits(2, values[0]) && scan.skip('/') && scan.readDigits(2, values[1]) && scan.skip('/') &&
+  scan.readDigits(2, values[2]) && scan.skip(',') && scan.readDigits(2, values[3]) && scan.skip(':') &&
+  scan.readDigits(2, values[4]) && scan.skip(':') && scan.readDigits(2, values[5]);
+}
+
+void benchmark(const __FlashStringHelper* name, void (*parse)()) {
+#ifdef COUNT_ALLOCATIONS
+  uint16_t allocationsBefore = allocations;
+  parse();
+  uint16_t count = allocations - allocationsBefore;
+#endif
+
+  uint32_t start = micros();
+  for (int i = 0; i < RUNS; i++) parse();
+  uint32_t elapsed = micros() - start;
+
+  Serial.print(name);
+  Serial.print(F("\tcycles: "));
+  Serial.print((uint32_t) ((uint64_t) elapsed * (F_CPU / 1000000UL) / RUNS));
+  Serial.print(F("\tallocations: "));
+#ifdef COUNT_ALLOCATIONS
+  Serial.println(count);
+#else
+  Serial.println(F("-"));
+#endif
+}
+
+void setup(){
+  Serial.begin(9600);
+
+#ifndef SIM800L_NO_STRING
+  benchmark(F("before"), parseWithString);
+#endif
+  benchmark(F("after"), parseWithScanner);
+}
+
+void loop(){
+
+}
@@ -0,0 +1,169 @@
+/* 
+ *  This library was written by Vittorio Esposito
+ *    https://github.com/VittorioEsposito
+ *
+ *  Designed to work with the GSM Sim800L.
+ *
+ *  ENG
+ *    This library uses SoftwareSerial, you can define RX and TX pins
+ *    in the header "Sim800L.h", by default pins are RX=10 and TX=11.
+ *    Be sure that GND is connected to arduino too. 
+ *    You can also change the RESET_PIN as you prefer.
+ *  
+ *  ESP
+ *    Esta libreria usa SoftwareSerial, se pueden cambiar los pines de RX y TX
+ *    en el archivo header, "Sim800L.h", por defecto los pines vienen configurado en
+ *    RX=10 TX=11.  
+ *    Tambien se puede cambiar el RESET_PIN por otro que prefiera
+ * 
+ *  ITA
+ *    Questa libreria utilizza la SoftwareSerial, si possono cambiare i pin di RX e TX
+ *    dall' intestazione "Sim800L.h", di default essi sono impostati come RX=10 RX=11
+ *    Assicurarsi di aver collegato il dispositivo al pin GND di Arduino.
+ *    E' anche possibile cambiare il RESET_PIN.
+ *
+ *
+ *   DEFAULT PINOUT: 
+ *        _____________________________
+ *       |  ARDUINO UNO >>>   Sim800L  |
+ *        -----------------------------
+ *            GND      >>>   GND
+ *        RX  10       >>>   TX    
+ *        TX  11       >>>   RX
+ *       RESET 2       >>>   RST 
+ *                 
+ *   POWER SOURCE 4.2V >>> VCC
+ *
+ *
+ *  SOFTWARE SERIAL NOTES:
+ *
+ *    PINOUT
+ *    The library has the following known limitations:
+ *    1. If using multiple software serial ports, only one can receive data at a time.
+ *    2. Not all pins on the Mega and Mega 2560 support change interrupts, so only the following can be used for RX: 10, 11, 12, 13, 14, 15, 50, 51, 52, 53, A8 (62), A9 (63), A10 (64), A11 (65), A12 (66), A13 (67), A14 (68), A15 (69).
+ *    3. Not all pins on the Leonardo and Micro support change interrupts, so only the following can be used for RX: 8, 9, 10, 11, 14 (MISO), 15 (SCK), 16 (MOSI).
+ *    4. On Arduino or Genuino 101 the current maximum RX speed is 57600bps
+ *    5. On Arduino or Genuino 101 RX doesn't work on Pin 13
+ *  
+ *    BAUD RATE
+ *    Supported baud rates are 300, 600, 1200, 2400, 4800, 9600, 14400, 19200, 28800, 31250, 38400, 57600, and 115200.
+ *
+ *
+ *  Edited on:  December 24, 2016
+ *    Editor:   Vittorio Esposito
+ *    
+ *  Original version by:   Cristian Steib
+ *        
+ *
+*/
+
+#include <Sim800L.h>
+#include <SoftwareSerial.h>               
+
+#define RX  10
+#define TX  11
+
+Sim800L GSM(RX, TX);
+
+/*
+ * In alternative:
+ * Sim800L GSM;                       // Use default pinout
+ * Sim800L GSM(RX, TX, RESET);        
+ * Sim800L GSM(RX, TX, RESET, LED);
+ */
+
+/*
+ * RAM budget of the library.
+ * Build it with SIM800L_NO_STRING defined in Sim800L.h to check that the
+ * char buffer APIs don't touch the heap.
+ *
+ * static: sizeof(Sim800L), it includes the response and URC buffers
+ * stack:  peak stack used by the call, measured painting the free RAM
+ * heap:   peak heap used by the call (String allocations), the painted
+ *         RAM it wrote above the heap break. A String freed before the
+ *         call returns lowers the break again, so the paint is the only
+ *         trace left of it
+ */
+
+#ifdef __AVR__
+extern char __heap_start;
+extern char *__brkval;
+
+char* heapEnd() {
+  return __brkval ? __brkval : &__heap_start;
+}
+
+#define PAINT 0x5A
+
+// fill the free RAM between the heap and the stack with a known value
+void paintStack() {
+  char top;
+  for (char* p = heapEnd(); p < &top - 16; p++) *p = PAINT;
+}
+
+// the heap reached the first painted bytes above its start. A run of them
+// is needed, a String can hold the paint value too
+char* heapPeak(char* start, char* top) {
+  char* p = start;
+  uint8_t run = 0;
+  while (p < top && run < 4) run = (*p++ == PAINT) ? run + 1 : 0;
+  return p - run;
+}
+
+// the stack reached the first byte not painted above the heap peak
+size_t stackUsed(char* heapTop, char* top) {
+  char* p = heapTop;
+  while (p < top && *p == PAINT) p++;
+  return top - p;
+}
+
+#define MEASURE(name, call) {                     \
+    char top;                                     \
+    char* heapBefore = heapEnd();                 \
+    paintStack();                                 \
+    call;                                         \
+    char* heapTop = heapPeak(heapBefore, &top);   \
+    report(F(name), stackUsed(heapTop, &top), heapTop - heapBefore); \
+  }
+#else
+#define MEASURE(name, call) { call; report(F(name), 0, 0); }
+#endif
+
+char buffer[160];
+
+void report(const __FlashStringHelper* name, size_t stack, size_t heap) {
+  Serial.print(name);
+  Serial.print(F("\tstack: "));
+  Serial.print(stack);
+  Serial.print(F("\theap: "));
+  Serial.println(heap);
+}
+
+void setup(){
+  Serial.begin(9600);
+  GSM.begin(4800);
+
+  Serial.print(F("static: "));
+  Serial.println(sizeof(Sim800L));
+
+  int day, month, year, hour, minute, second;
+
+  MEASURE("reset", GSM.reset());
+  MEASURE("getProductInfo", GSM.getProductInfo(buffer, sizeof(buffer)));
+  MEASURE("getOperator", GSM.getOperator(buffer, sizeof(buffer)));
+  MEASURE("signalQuality", GSM.signalQuality(buffer, sizeof(buffer)));
+  MEASURE("getCallStatus", GSM.getCallStatus());
+  MEASURE("readSms", GSM.readSms(1, buffer, sizeof(buffer)));
+  MEASURE("getNumberSms", GSM.getNumberSms(1, buffer, sizeof(buffer)));
+  MEASURE("RTCtime", GSM.RTCtime(&day, &month, &year, &hour, &minute, &second));
+  MEASURE("dateNet", GSM.dateNet(buffer, sizeof(buffer)));
+  MEASURE("calculateLocation", GSM.calculateLocation());
+#ifndef SIM800L_NO_STRING
+  MEASURE("readSms String", GSM.readSms(1));
+  MEASURE("signalQuality String", GSM.signalQuality());
+#endif
+}
+
+void loop(){
+
+}